@@ -0,0 +1,33 @@
+// Stand-in for libFuzzer's main() on compilers without it.
+// Runs every input file given on the command line once.
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, size_t size);
+
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage:\n    chip8-fuzz <input>...\n";
+        return 0;
+    }
+
+    for (int i{ 1 }; i < argc; ++i) {
+        std::ifstream fs{ argv[i], std::ios_base::binary };
+        if (fs.fail()) {
+            std::cerr << "Unable to open " << argv[i] << '\n';
+            return 1;
+        }
+        const std::vector<std::uint8_t> input{
+            std::istreambuf_iterator<char>(fs),
+            std::istreambuf_iterator<char>()
+        };
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    std::cout << "Ran " << argc - 1 << " inputs\n";
+}
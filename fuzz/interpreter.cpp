@@ -0,0 +1,94 @@
+// Runs arbitrary ROM bytes and keypad input through the interpreter.
+//
+// Input: u8 flags, u8 key count, key count u16 keypad states, ROM.
+// The low 4 bits of flags are the number of frames to run minus one,
+// bit 7 selects VIP timing. Each frame uses the next keypad state,
+// cycling through them. Faults end the run early.
+//
+// The machine is restored from one snapshot between inputs instead of
+// being rebuilt, so an input costs a 4k copy plus what it executes.
+#include "Chip8.hpp"
+#include "Timing.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+
+
+namespace {
+
+constexpr size_t cycles_per_frame{ 10 };
+// Keeps slow inputs from dominating under VIP timing
+constexpr std::uint64_t max_cycles{ 4096 };
+
+
+struct Harness {
+    Chip8 chip8{};
+    const Snapshot blank{ chip8.snapshot() };
+    Snapshot state{};
+};
+
+} // namespace
+
+
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, size_t size) {
+    static Harness h{};
+
+    if (size < 2) { return 0; }
+    const Byte flags{ data[0] };
+    const size_t key_count{ data[1] & 0x0Fu };
+    const size_t frames{ (flags & 0x0Fu) + 1u };
+    const bool vip{ (flags & 0x80u) != 0 };
+
+    if (size < 2 + 2 * key_count) { return 0; }
+    const std::uint8_t* keys{ data + 2 };
+    const std::uint8_t* rom{ keys + 2 * key_count };
+    const size_t rom_size{
+        std::min<size_t>(data + size - rom, Chip8Base::memory_size - Chip8Base::program_address)
+    };
+
+    h.state = h.blank;
+    std::memcpy(h.state.memory.data() + Chip8Base::program_address, rom, rom_size);
+    h.chip8.load_state(h.state);
+
+    Chip8& chip8 = h.chip8;
+    std::optional<timing::Clock> clock{};
+    if (vip) { clock.emplace(); }
+
+    for (size_t frame{ 0 }; frame < frames; ++frame) {
+        if (key_count) {
+            const size_t k{ frame % key_count };
+            const std::uint16_t pressed = keys[2 * k] | keys[2 * k + 1] << 8;
+            for (Byte id{ 0 }; id < 16; ++id) {
+                if (pressed & (1u << id)) {
+                    chip8.key_press(id);
+                } else {
+                    chip8.key_release(id);
+                }
+            }
+        }
+
+        if (clock) {
+            while (!clock->step(chip8) &&
+                chip8.get_fault() == Chip8::Fault::none &&
+                chip8.get_cycle_count() < max_cycles)
+            {}
+        } else {
+            for (size_t cycle{ 0 }; cycle < cycles_per_frame; ++cycle) {
+                chip8.emulate_cycle();
+            }
+            chip8.update_timers();
+        }
+
+        if (chip8.get_fault() != Chip8::Fault::none || chip8.get_cycle_count() >= max_cycles) {
+            break;
+        }
+    }
+
+    if (chip8.get_stack_depth() > 16) {
+        std::abort();
+    }
+
+    return 0;
+}
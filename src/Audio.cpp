@@ -0,0 +1,259 @@
+#include "Audio.hpp"
+#include <SFML/Audio.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+
+void LatencyStats::record(std::chrono::nanoseconds latency) noexcept {
+    const std::int64_t ns{ latency.count() };
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(ns, std::memory_order_relaxed);
+    last_ns_.store(ns, std::memory_order_relaxed);
+
+    std::int64_t prev{ max_ns_.load(std::memory_order_relaxed) };
+    while (prev < ns &&
+        !max_ns_.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+}
+
+
+LatencyStats::Summary LatencyStats::summary() const noexcept {
+    Summary s{};
+    s.count = count_.load(std::memory_order_relaxed);
+    s.last = std::chrono::nanoseconds{ last_ns_.load(std::memory_order_relaxed) };
+    s.max = std::chrono::nanoseconds{ max_ns_.load(std::memory_order_relaxed) };
+    if (s.count) {
+        s.mean = std::chrono::nanoseconds{
+            total_ns_.load(std::memory_order_relaxed) /
+            static_cast<std::int64_t>(s.count)
+        };
+    }
+    return s;
+}
+
+
+
+
+
+void Synth::render(
+    std::span<std::int16_t> out,
+    std::chrono::nanoseconds output_latency
+) noexcept {
+
+    const auto now = std::chrono::steady_clock::now();
+
+    BuzzerEvent event;
+    while (queue_.try_pop(event)) {
+        latency_.record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - event.emitted)
+            + output_latency
+        );
+        apply(event);
+    }
+
+    constexpr std::int16_t amplitude{ 6000 };
+
+    switch (current_.kind) {
+        case BuzzerEvent::Kind::off:
+            std::fill(out.begin(), out.end(), std::int16_t{ 0 });
+            break;
+
+        case BuzzerEvent::Kind::on:
+            for (auto& sample : out) {
+                sample = phase_ < 0.5 ? amplitude : -amplitude;
+                phase_ += step_;
+                if (phase_ >= 1.0) { phase_ -= 1.0; }
+            }
+            break;
+
+        case BuzzerEvent::Kind::pattern:
+            // phase_ indexes into the 128-bit pattern
+            for (auto& sample : out) {
+                const auto bit = static_cast<unsigned>(phase_);
+                const bool high =
+                    current_.pattern[bit / 8] & (0x80u >> (bit % 8));
+                sample = high ? amplitude : -amplitude;
+                phase_ += step_;
+                if (phase_ >= 128.0) { phase_ -= 128.0; }
+            }
+            break;
+    }
+}
+
+
+void Synth::apply(const BuzzerEvent& event) noexcept {
+    const bool restart{ event.kind != current_.kind };
+    current_ = event;
+
+    switch (event.kind) {
+        case BuzzerEvent::Kind::off:
+            break;
+        case BuzzerEvent::Kind::on:
+            step_ = buzzer_hz / sample_rate;
+            break;
+        case BuzzerEvent::Kind::pattern:
+            // XO-CHIP: 4000 * 2^((pitch - 64) / 48) bits per second
+            step_ = 4000.0 * std::exp2((event.pitch - 64.0) / 48.0) / sample_rate;
+            break;
+    }
+
+    if (restart) { phase_ = 0.0; }
+}
+
+
+
+
+
+ClockedSink::~ClockedSink() {
+    // Derived classes must stop() in their destructor,
+    // before their write() becomes unavailable.
+    stop();
+}
+
+
+void ClockedSink::start(Synth& synth) {
+    if (running_.exchange(true)) { return; }
+
+    thread_ = std::thread{ [this, &synth] {
+        using clock = std::chrono::steady_clock;
+        const auto chunk_duration =
+            std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>{ double(chunk_size) / Synth::sample_rate }
+            );
+
+        auto next = clock::now();
+        while (running_.load(std::memory_order_relaxed)) {
+            synth.render(buffer_, chunk_duration);
+            write(buffer_);
+            next += chunk_duration;
+            std::this_thread::sleep_until(next);
+        }
+    } };
+}
+
+
+void ClockedSink::stop() {
+    running_.store(false);
+    if (thread_.joinable()) { thread_.join(); }
+}
+
+
+
+
+
+WavFileSink::WavFileSink(const std::string& path) :
+    file_{ path, std::ios_base::binary | std::ios_base::trunc }
+{
+    if (file_.fail()) {
+        throw std::runtime_error{ "Unable to open audio file: " + path };
+    }
+    write_header();
+}
+
+
+WavFileSink::~WavFileSink() {
+    stop();
+    // Patch the sizes now that the length is known
+    file_.seekp(0);
+    write_header();
+}
+
+
+void WavFileSink::write(std::span<const std::int16_t> samples) {
+    for (std::int16_t s : samples) {
+        const auto u = static_cast<std::uint16_t>(s);
+        const char le[2]{ static_cast<char>(u & 0xFF), static_cast<char>(u >> 8) };
+        file_.write(le, 2);
+    }
+    data_bytes_ += static_cast<std::uint32_t>(samples.size() * 2);
+}
+
+
+void WavFileSink::write_header() {
+    auto put32 = [this](std::uint32_t v) {
+        const char le[4]{
+            static_cast<char>(v & 0xFF), static_cast<char>((v >> 8) & 0xFF),
+            static_cast<char>((v >> 16) & 0xFF), static_cast<char>(v >> 24)
+        };
+        file_.write(le, 4);
+    };
+    auto put16 = [this](std::uint16_t v) {
+        const char le[2]{ static_cast<char>(v & 0xFF), static_cast<char>(v >> 8) };
+        file_.write(le, 2);
+    };
+
+    file_.write("RIFF", 4);
+    put32(36 + data_bytes_);
+    file_.write("WAVEfmt ", 8);
+    put32(16);                      // fmt chunk size
+    put16(1);                       // PCM
+    put16(1);                       // Mono
+    put32(Synth::sample_rate);
+    put32(Synth::sample_rate * 2);  // Byte rate
+    put16(2);                       // Block align
+    put16(16);                      // Bits per sample
+    file_.write("data", 4);
+    put32(data_bytes_);
+}
+
+
+
+
+
+namespace {
+
+// Device output through SFML. SFML calls onGetData()
+// from its own streaming thread.
+class SfmlSink final : public AudioSink, private sf::SoundStream {
+private:
+    // SFML keeps this many chunks queued on the device
+    static constexpr unsigned queued_chunks{ 3u };
+
+    Synth* synth_{ nullptr };
+    std::array<sf::Int16, chunk_size> buffer_{};
+
+public:
+    ~SfmlSink() override { stop(); }
+
+    void start(Synth& synth) override {
+        synth_ = &synth;
+        sf::SoundStream::initialize(1, Synth::sample_rate);
+        sf::SoundStream::play();
+    }
+
+    void stop() override {
+        sf::SoundStream::stop();
+    }
+
+private:
+    bool onGetData(Chunk& data) override {
+        const std::chrono::nanoseconds queued{
+            1'000'000'000ll * queued_chunks * chunk_size / Synth::sample_rate
+        };
+        synth_->render(buffer_, queued);
+        data.samples = buffer_.data();
+        data.sampleCount = buffer_.size();
+        return true;
+    }
+
+    void onSeek(sf::Time) override {}
+};
+
+} // namespace
+
+
+
+std::unique_ptr<AudioSink> make_audio_sink(std::string_view spec) {
+
+    if (spec == "sfml") {
+        return std::make_unique<SfmlSink>();
+    }
+    if (spec == "null") {
+        return std::make_unique<NullSink>();
+    }
+    if (spec.starts_with("wav:")) {
+        return std::make_unique<WavFileSink>(std::string{ spec.substr(4) });
+    }
+    throw std::invalid_argument{ "Unknown audio sink: " + std::string{ spec } };
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include "Buzzer.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+
+// Buzzer-event-to-presentation latency, as seen by the audio thread.
+// Includes an estimate of the sink's own output buffering.
+class LatencyStats {
+private:
+    std::atomic<std::uint64_t> count_{ 0 };
+    std::atomic<std::int64_t> total_ns_{ 0 };
+    std::atomic<std::int64_t> last_ns_{ 0 };
+    std::atomic<std::int64_t> max_ns_{ 0 };
+
+public:
+    struct Summary {
+        std::uint64_t count{};
+        std::chrono::nanoseconds last{};
+        std::chrono::nanoseconds max{};
+        std::chrono::nanoseconds mean{};
+    };
+
+    void record(std::chrono::nanoseconds latency) noexcept;
+    Summary summary() const noexcept;
+};
+
+
+
+// Consumes buzzer events and synthesizes mono 16-bit samples.
+// Never allocates or locks: safe to call from an audio callback.
+class Synth {
+public:
+    static constexpr unsigned sample_rate{ 44100u };
+    static constexpr double buzzer_hz{ 440.0 };
+
+private:
+    BuzzerQueue& queue_;
+    LatencyStats& latency_;
+
+    BuzzerEvent current_{};
+    // Position within the current waveform period
+    double phase_{ 0.0 };
+    double step_{ 0.0 };
+
+public:
+    Synth(BuzzerQueue& queue, LatencyStats& latency) noexcept :
+        queue_{ queue }, latency_{ latency }
+    {}
+
+    // Drain pending events and fill the whole output buffer.
+    // Events take effect at the start of the buffer.
+    void render(
+        std::span<std::int16_t> out,
+        std::chrono::nanoseconds output_latency
+    ) noexcept;
+
+private:
+    void apply(const BuzzerEvent& event) noexcept;
+};
+
+
+
+class AudioSink {
+public:
+    // Samples per chunk handed to the device
+    static constexpr size_t chunk_size{ 512u };
+
+    virtual ~AudioSink() = default;
+
+    virtual void start(Synth& synth) = 0;
+    virtual void stop() = 0;
+};
+
+
+// Pulls chunks from the synth on its own thread at real-time pace.
+// Base for sinks that have no device callback of their own.
+class ClockedSink : public AudioSink {
+private:
+    std::thread thread_;
+    std::atomic<bool> running_{ false };
+    std::array<std::int16_t, chunk_size> buffer_{};
+
+public:
+    ClockedSink() = default;
+    ClockedSink(const ClockedSink&) = delete;
+    ClockedSink& operator=(const ClockedSink&) = delete;
+    ~ClockedSink() override;
+
+    void start(Synth& synth) override;
+    void stop() override;
+
+protected:
+    virtual void write(std::span<const std::int16_t> samples) = 0;
+};
+
+
+// Discards samples. For headless machines and benchmarks.
+class NullSink final : public ClockedSink {
+public:
+    ~NullSink() override { stop(); }
+protected:
+    void write(std::span<const std::int16_t>) override {}
+};
+
+
+// Writes a mono 16-bit PCM .wav file.
+class WavFileSink final : public ClockedSink {
+private:
+    std::ofstream file_;
+    std::uint32_t data_bytes_{ 0 };
+
+public:
+    explicit WavFileSink(const std::string& path);
+    ~WavFileSink() override;
+
+protected:
+    void write(std::span<const std::int16_t> samples) override;
+
+private:
+    void write_header();
+};
+
+
+
+// Creates a sink from a spec: "sfml", "null" or "wav:<path>".
+// Throws std::invalid_argument on an unknown spec.
+std::unique_ptr<AudioSink> make_audio_sink(std::string_view spec);
+
+
+
+// Owns the event queue, synth and sink.
+// Attach queue() to the core with Chip8::set_buzzer_queue().
+class Audio {
+private:
+    BuzzerQueue queue_{};
+    LatencyStats latency_{};
+    Synth synth_{ queue_, latency_ };
+    std::unique_ptr<AudioSink> sink_;
+
+public:
+    explicit Audio(std::unique_ptr<AudioSink> sink) :
+        sink_{ std::move(sink) }
+    {
+        sink_->start(synth_);
+    }
+
+    Audio(const Audio&) = delete;
+    Audio& operator=(const Audio&) = delete;
+
+    ~Audio() { sink_->stop(); }
+
+    BuzzerQueue& queue() noexcept { return queue_; }
+    const LatencyStats& latency() const noexcept { return latency_; }
+};
@@ -0,0 +1,31 @@
+#pragma once
+#include "SpscQueue.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+
+// Buzzer state change emitted by the core.
+// Timestamped both in emulated cycles (for deterministic
+// consumers) and in host time (for latency measurement).
+struct BuzzerEvent {
+    enum class Kind : unsigned char {
+        off,
+        on,      // Plain square-wave buzzer
+        pattern  // XO-CHIP style 1-bit sample pattern
+    };
+
+    Kind kind{ Kind::off };
+
+    // XO-CHIP playback pitch, 64 is 4000 Hz
+    unsigned char pitch{ 64 };
+
+    // 128 1-bit samples, MSB first
+    std::array<unsigned char, 16u> pattern{};
+
+    std::uint64_t cycle{};
+    std::chrono::steady_clock::time_point emitted{};
+};
+
+
+using BuzzerQueue = SpscQueue<BuzzerEvent, 256u>;
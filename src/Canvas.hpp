@@ -1,5 +1,6 @@
 #pragma once
 #include "Chip8.hpp"
+#include "Display.hpp"
 #include <SFML/Config.hpp>
 #include <SFML/Graphics.hpp>
 #include <SFML/Window/ContextSettings.hpp>
@@ -9,7 +10,7 @@
 #include <SFML/Window/WindowStyle.hpp>
 
 
-class Canvas {
+class Canvas final : public Display {
 private:
     sf::RenderWindow window_;
 
@@ -56,33 +57,11 @@ public:
         return window_;
     }
 
-
-    void update(const Chip8::framebuffer_t& fb) {
-        const sf::Color bg{ 0x00, 0x2B, 0x36 }; // Solarized Dark
-        const sf::Color fg{ 0x83, 0x94, 0x96 }; //
-        const sf::Color offset{ fg - bg };
-
-        for (size_t i{ 0 }; i < fb.size(); ++i) {
-            size_t j{ i * 4 };
-
-            // RGBA
-            tex_buffer_[j + 0] = bg.r + fb[i] * offset.r;
-            tex_buffer_[j + 1] = bg.g + fb[i] * offset.g;
-            tex_buffer_[j + 2] = bg.b + fb[i] * offset.b;
-            tex_buffer_[j + 3] = 0xFF;
-        }
-        tex_.update(tex_buffer_.data());
-    }
-
-    void redraw() {
-        window_.clear(sf::Color{ 0u, 0u, 0u });
-        window_.draw(sprite_);
-        window_.display();
-    }
-
+    bool is_open() const override { return window_.isOpen(); }
+    void close() override { window_.close(); }
 
 
-    void process_events(Chip8& chip8) {
+    void process_events(Chip8& chip8) override {
 
         sf::Event event;
         while (window_.pollEvent(event)) {
@@ -106,6 +85,33 @@ public:
 
     }
 
+protected:
+    void upload(const Chip8::framebuffer_t& fb) override {
+        const sf::Color bg{ 0x00, 0x2B, 0x36 }; // Solarized Dark
+        const sf::Color fg{ 0x83, 0x94, 0x96 }; //
+        const sf::Color offset{ fg - bg };
+
+        for (size_t y{ 0 }; y < Chip8Base::fb_height; ++y) {
+            for (size_t x{ 0 }; x < Chip8Base::fb_width; ++x) {
+                const Byte on = Chip8::pixel(fb, x, y);
+                size_t j{ (y * Chip8Base::fb_width + x) * 4 };
+
+                // RGBA
+                tex_buffer_[j + 0] = bg.r + on * offset.r;
+                tex_buffer_[j + 1] = bg.g + on * offset.g;
+                tex_buffer_[j + 2] = bg.b + on * offset.b;
+                tex_buffer_[j + 3] = 0xFF;
+            }
+        }
+        tex_.update(tex_buffer_.data());
+    }
+
+    void present() override {
+        window_.clear(sf::Color{ 0u, 0u, 0u });
+        window_.draw(sprite_);
+        window_.display();
+    }
+
 private:
     void process_key_pressed(Chip8& chip8, const sf::Event& event) {
 
@@ -116,22 +122,26 @@ private:
                 window_.close();
                 break;
 
-            case Key::Num1: chip8.key_press(0x01); break;
-            case Key::Num2: chip8.key_press(0x02); break;
-            case Key::Num3: chip8.key_press(0x03); break;
-            case Key::Num4: chip8.key_press(0x0C); break;
-            case Key::Q:    chip8.key_press(0x04); break;
-            case Key::W:    chip8.key_press(0x05); break;
-            case Key::E:    chip8.key_press(0x06); break;
-            case Key::R:    chip8.key_press(0x0D); break;
-            case Key::A:    chip8.key_press(0x07); break;
-            case Key::S:    chip8.key_press(0x08); break;
-            case Key::D:    chip8.key_press(0x09); break;
-            case Key::F:    chip8.key_press(0x0E); break;
-            case Key::Z:    chip8.key_press(0x0A); break;
-            case Key::X:    chip8.key_press(0x00); break;
-            case Key::C:    chip8.key_press(0x0B); break;
-            case Key::V:    chip8.key_press(0x0F); break;
+            case Key::BackSpace: hotkeys().rewind = true; break;
+            case Key::F5:        hotkeys().quick_save = true; break;
+            case Key::F9:        hotkeys().quick_load = true; break;
+
+            case Key::Num1: press(chip8, 0x01); break;
+            case Key::Num2: press(chip8, 0x02); break;
+            case Key::Num3: press(chip8, 0x03); break;
+            case Key::Num4: press(chip8, 0x0C); break;
+            case Key::Q:    press(chip8, 0x04); break;
+            case Key::W:    press(chip8, 0x05); break;
+            case Key::E:    press(chip8, 0x06); break;
+            case Key::R:    press(chip8, 0x0D); break;
+            case Key::A:    press(chip8, 0x07); break;
+            case Key::S:    press(chip8, 0x08); break;
+            case Key::D:    press(chip8, 0x09); break;
+            case Key::F:    press(chip8, 0x0E); break;
+            case Key::Z:    press(chip8, 0x0A); break;
+            case Key::X:    press(chip8, 0x00); break;
+            case Key::C:    press(chip8, 0x0B); break;
+            case Key::V:    press(chip8, 0x0F); break;
 
             default: break;
         }
@@ -142,22 +152,24 @@ private:
         using Key = sf::Keyboard::Key;
 
         switch (event.key.code) {
-            case Key::Num1: chip8.key_release(0x01); break;
-            case Key::Num2: chip8.key_release(0x02); break;
-            case Key::Num3: chip8.key_release(0x03); break;
-            case Key::Num4: chip8.key_release(0x0C); break;
-            case Key::Q:    chip8.key_release(0x04); break;
-            case Key::W:    chip8.key_release(0x05); break;
-            case Key::E:    chip8.key_release(0x06); break;
-            case Key::R:    chip8.key_release(0x0D); break;
-            case Key::A:    chip8.key_release(0x07); break;
-            case Key::S:    chip8.key_release(0x08); break;
-            case Key::D:    chip8.key_release(0x09); break;
-            case Key::F:    chip8.key_release(0x0E); break;
-            case Key::Z:    chip8.key_release(0x0A); break;
-            case Key::X:    chip8.key_release(0x00); break;
-            case Key::C:    chip8.key_release(0x0B); break;
-            case Key::V:    chip8.key_release(0x0F); break;
+            case Key::BackSpace: hotkeys().rewind = false; break;
+
+            case Key::Num1: release(chip8, 0x01); break;
+            case Key::Num2: release(chip8, 0x02); break;
+            case Key::Num3: release(chip8, 0x03); break;
+            case Key::Num4: release(chip8, 0x0C); break;
+            case Key::Q:    release(chip8, 0x04); break;
+            case Key::W:    release(chip8, 0x05); break;
+            case Key::E:    release(chip8, 0x06); break;
+            case Key::R:    release(chip8, 0x0D); break;
+            case Key::A:    release(chip8, 0x07); break;
+            case Key::S:    release(chip8, 0x08); break;
+            case Key::D:    release(chip8, 0x09); break;
+            case Key::F:    release(chip8, 0x0E); break;
+            case Key::Z:    release(chip8, 0x0A); break;
+            case Key::X:    release(chip8, 0x00); break;
+            case Key::C:    release(chip8, 0x0B); break;
+            case Key::V:    release(chip8, 0x0F); break;
 
             default: break;
         }
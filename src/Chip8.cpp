@@ -23,23 +23,267 @@ const std::array<Byte, 80> Chip8::fontset{
 
 
 
-void Chip8::decode_opcode() noexcept {
+Chip8Base::Memory::Memory(std::shared_ptr<const Image> image) noexcept :
+    image_{ std::move(image) }
+{
+    for (size_t p{ 0 }; p < page_count; ++p) {
+        pages_[p] = (*image_)[p].data();
+    }
+}
+
+
+Chip8Base::Memory::Memory(const Memory& other) :
+    image_{ other.image_ },
+    pages_{ other.pages_ }
+{
+    // The destructor doesn't run if this throws, free what was copied
+    try {
+        for (size_t p{ 0 }; p < page_count; ++p) {
+            if (other.owned_ & (1u << p)) {
+                pages_[p] = (*image_)[p].data();
+                copy_page_from(other, p);
+            }
+        }
+    } catch (...) {
+        release_all();
+        throw;
+    }
+}
+
+
+Chip8Base::Memory& Chip8Base::Memory::operator=(const Memory& other) {
+    if (this != &other) {
+        Memory copy{ other };
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+
+Chip8Base::Memory::Memory(Memory&& other) noexcept :
+    image_{ other.image_ },
+    pages_{ other.pages_ },
+    owned_{ std::exchange(other.owned_, 0) }
+{
+    // Leave other valid, reading from the image
+    for (size_t p{ 0 }; p < page_count; ++p) {
+        other.pages_[p] = (*image_)[p].data();
+    }
+}
+
+
+Chip8Base::Memory& Chip8Base::Memory::operator=(Memory&& other) noexcept {
+    if (this != &other) {
+        release_all();
+        image_ = other.image_;
+        pages_ = other.pages_;
+        owned_ = std::exchange(other.owned_, 0);
+        for (size_t p{ 0 }; p < page_count; ++p) {
+            other.pages_[p] = (*image_)[p].data();
+        }
+    }
+    return *this;
+}
+
+
+Chip8Base::Memory::~Memory() {
+    release_all();
+}
+
+
+
+void Chip8Base::Memory::copy_page_from(const Memory& src, size_t p) {
+    if (!(src.owned_ & (1u << p)) && src.image_ == image_) {
+        release(p);
+        return;
+    }
+    std::memcpy(writable_page(p), src.pages_[p], page_size);
+}
+
+
+void Chip8Base::Memory::copy_to(std::span<Byte, memory_size> out) const noexcept {
+    for (size_t p{ 0 }; p < page_count; ++p) {
+        std::memcpy(out.data() + p * page_size, pages_[p], page_size);
+    }
+}
+
+
+void Chip8Base::Memory::assign(std::span<const Byte, memory_size> in) {
+    for (size_t p{ 0 }; p < page_count; ++p) {
+        const Byte* src{ in.data() + p * page_size };
+        if (std::memcmp(src, (*image_)[p].data(), page_size) == 0) {
+            release(p);
+        } else {
+            std::memcpy(writable_page(p), src, page_size);
+        }
+    }
+}
+
+
+Byte* Chip8Base::Memory::writable_page(size_t p) {
+    if (!(owned_ & (1u << p))) {
+        // Copy on first write
+        auto* page = new Page{ (*image_)[p] };
+        pages_[p] = page->data();
+        owned_ |= 1u << p;
+    }
+    // Owned pages were allocated non-const
+    return const_cast<Byte*>(pages_[p]);
+}
+
+
+void Chip8Base::Memory::release(size_t p) noexcept {
+    if (owned_ & (1u << p)) {
+        delete reinterpret_cast<const Page*>(pages_[p]);
+        owned_ &= ~(1u << p);
+    }
+    pages_[p] = (*image_)[p].data();
+}
+
+
+void Chip8Base::Memory::release_all() noexcept {
+    if (!image_) { return; }
+    for (size_t p{ 0 }; p < page_count; ++p) {
+        release(p);
+    }
+}
+
+
+
+
+
+std::shared_ptr<const Chip8::MemoryImage> Chip8::make_image(std::span<const Byte> program) {
+    auto image = std::make_shared<MemoryImage>();
+    auto bytes = std::as_writable_bytes(std::span{ *image });
+
+    std::memcpy(bytes.data() + font_address, fontset.data(), fontset.size());
+
+    const size_t size{ std::min<size_t>(program.size(), memory_size - program_address) };
+    if (size) {
+        std::memcpy(bytes.data() + program_address, program.data(), size);
+    }
+
+    return image;
+}
+
+
+const std::shared_ptr<const Chip8::MemoryImage>& Chip8::empty_image() {
+    static const std::shared_ptr<const MemoryImage> image{ make_image({}) };
+    return image;
+}
+
+
+
+void Chip8::save_state(Snapshot& out) const noexcept {
+    out.rng = rng.state;
+    out.cycle_count = cycle_count;
+
+    out.frame = frame;
+    memory.copy_to(out.memory);
+    out.V = V;
+    out.stack = stack.stack_;
+
+    out.opcode = opcode;
+    out.I = I;
+    out.pc = pc;
+    out.keys = keys;
+
+    out.sp = stack.sp_;
+    out.delay_timer = delay_timer;
+    out.sound_timer = sound_timer;
+    out.draw_flag = draw_flag;
+    out.buzzing = buzzing;
+    out.fault = static_cast<Byte>(fault);
+
+    out.reserved = {};
+}
+
+
+void Chip8::copy_dirty_from(const Chip8& src) {
+
+    const std::uint16_t pages = dirty_pages | src.dirty_pages;
+    for (size_t page{ 0 }; page < page_count; ++page) {
+        if (pages & (1u << page)) {
+            memory.copy_page_from(src.memory, page);
+        }
+    }
+
+    const std::uint32_t rows = dirty_rows | src.dirty_rows;
+    for (size_t row{ 0 }; row < fb_height; ++row) {
+        if (rows & (1u << row)) {
+            frame[row] = src.frame[row];
+        }
+    }
+
+    V = src.V;
+    opcode = src.opcode;
+    I = src.I;
+    pc = src.pc;
+    delay_timer = src.delay_timer;
+    sound_timer = src.sound_timer;
+    stack = src.stack;
+    keys = src.keys;
+    rng = src.rng;
+
+    draw_flag = src.draw_flag;
+    cycle_count = src.cycle_count;
+    buzzing = src.buzzing;
+    fault = src.fault;
+
+    dirty_pages = src.dirty_pages;
+    dirty_rows = src.dirty_rows;
+}
+
+
+
+void Chip8::load_state(const Snapshot& in) {
+    rng.state = in.rng;
+    cycle_count = in.cycle_count;
+
+    frame = in.frame;
+    memory.assign(in.memory);
+    V = in.V;
+    stack.stack_ = in.stack;
+
+    opcode = in.opcode;
+    I = in.I;
+    pc = in.pc;
+    keys = in.keys;
+
+    stack.sp_ = in.sp;
+    delay_timer = in.delay_timer;
+    sound_timer = in.sound_timer;
+    draw_flag = in.draw_flag;
+    buzzing = in.buzzing;
+    fault = static_cast<Fault>(in.fault);
+
+    dirty_pages = static_cast<std::uint16_t>((1u << page_count) - 1);
+    dirty_rows = static_cast<std::uint32_t>((1ull << fb_height) - 1);
+}
+
+
+
+void Chip8::decode_opcode() {
 
     switch (opcode & 0xF000) {
         case 0x0000:
             switch (opcode) {
                 case 0x00E0:
                     // 00E0 - Clear the screen
-                    std::fill(frame.begin(), frame.end(), 0);
+                    frame.fill(0);
+                    dirty_rows = static_cast<std::uint32_t>((1ull << fb_height) - 1);
                     pc += 2;
                     break;
                 case 0x00EE:
                     // 00EE - Return from subroutine
-                    pc = stack.pop();
+                    if (!stack.pop(pc)) {
+                        halt(Fault::stack_underflow);
+                        break;
+                    }
                     pc += 2;
                     break;
                 default:
-                    unknown_opcode(opcode);
+                    halt(Fault::unknown_opcode);
             }
             break;
 
@@ -50,7 +294,10 @@ void Chip8::decode_opcode() noexcept {
 
         case 0x2000:
             // 2NNN - Call subroutine at NNN
-            stack.push(pc);
+            if (!stack.push(pc)) {
+                halt(Fault::stack_overflow);
+                break;
+            }
             pc = opcode & 0x0FFF;
             break;
 
@@ -92,7 +339,7 @@ void Chip8::decode_opcode() noexcept {
                     }
                     break;
                 default:
-                    unknown_opcode(opcode);
+                    halt(Fault::unknown_opcode);
             }
             break;
 
@@ -175,7 +422,7 @@ void Chip8::decode_opcode() noexcept {
                     pc += 2;
                     break;
                 default:
-                    unknown_opcode(opcode);
+                    halt(Fault::unknown_opcode);
             }
             break;
 
@@ -193,7 +440,7 @@ void Chip8::decode_opcode() noexcept {
                     }
                     break;
                 default:
-                    unknown_opcode(opcode);
+                    halt(Fault::unknown_opcode);
             }
             break;
 
@@ -211,7 +458,7 @@ void Chip8::decode_opcode() noexcept {
         case 0xC000:
             // CXNN - Set VX to rand() & NN
             V[(opcode & 0x0F00) >> 8] =
-                rand_byte() & (opcode & 0x00FF);
+                rng.next_byte() & (opcode & 0x00FF);
             pc += 2;
             break;
 
@@ -225,29 +472,20 @@ void Chip8::decode_opcode() noexcept {
                 Byte Y = (opcode & 0x00F0) >> 4;
                 Byte N = (opcode & 0x000F);
 
-                auto bits_to_bytes = [](Byte bits) {
-                    std::array<Byte, 8> bytes;
-                    for (unsigned i{ 0 }; i < bytes.size(); ++i) {
-                        bytes[i] =
-                            (bits & (0b10000000 >> i)) >> (bytes.size() - i - 1);
-                    }
-                    return bytes;
-                };
+                // Start position wraps around,
+                // the sprite itself is clipped at the edges
+                const size_t x0{ V[X] % fb_width };
+                const size_t y0{ V[Y] % fb_height };
 
                 V[0xF] = 0;
-                for (size_t i{ 0 }; i < N; ++i) {
-                    auto row = bits_to_bytes(memory[I + i]);
-
-                    for (size_t j{ 0 }; j < 8; ++j) {
-
-                        size_t pos{
-                            (V[Y] + i) * fb_width + (V[X] + j)
-                        };
-
-                        V[0xF] |= row[j] && frame[pos];
-
-                        frame[pos] ^= row[j];
-                    }
+                for (size_t i{ 0 }; i < N && y0 + i < fb_height; ++i) {
+                    const std::uint64_t sprite{
+                        (std::uint64_t{ memory.read(I + i) } << (fb_width - 8)) >> x0
+                    };
+
+                    V[0xF] |= (frame[y0 + i] & sprite) != 0;
+                    frame[y0 + i] ^= sprite;
+                    mark_row(y0 + i);
                 }
 
             }
@@ -263,15 +501,15 @@ void Chip8::decode_opcode() noexcept {
                 case 0x009E:
                     // EX9E - Skip next instr.
                     // if key in VX is pressed
-                    pc += key[V[X]] ? 4 : 2;
+                    pc += is_pressed(V[X]) ? 4 : 2;
                     break;
                 case 0x00A1:
                     // EXA1 - Skip next instr.
                     // if key in VX in not pressed
-                    pc += !key[V[X]] ? 4 : 2;
+                    pc += !is_pressed(V[X]) ? 4 : 2;
                     break;
                 default:
-                    unknown_opcode(opcode);
+                    halt(Fault::unknown_opcode);
             }
             break;
 
@@ -302,6 +540,7 @@ void Chip8::decode_opcode() noexcept {
                 case 0x0018:
                     // FX18 - Set the sound timer to VX
                     sound_timer = V[X];
+                    update_buzzer();
                     pc += 2;
                     break;
                 case 0x001E:
@@ -313,9 +552,7 @@ void Chip8::decode_opcode() noexcept {
                     // FX29 - Set I to the location
                     // of the sprite for the char in VX
 
-                    // Fonts start at 0 address
-                    I = (fonts.data() - memory.data())
-                        + static_cast<std::ptrdiff_t>(5) * V[X];
+                    I = font_address + 5u * V[X];
 
                     pc += 2;
                     break;
@@ -323,42 +560,38 @@ void Chip8::decode_opcode() noexcept {
                     // FX33 - Store the binary-coded decimal
                     // representation of VX with
                     {
-                        Byte val{ V[X] };
-                        memory[I] = val / 100;
-                        val -= memory[I] * 100;
-                        memory[I + 1] = val / 10;
-                        val -= memory[I + 1] * 10;
-                        memory[I + 2] = val;
+                        const Byte val{ V[X] };
+                        memory.write(I, val / 100);
+                        memory.write(I + 1u, val / 10 % 10);
+                        memory.write(I + 2u, val % 10);
                     }
+                    mark_pages(I, 3);
                     pc += 2;
                     break;
                 case 0x0055:
                     // FX55 - Stores from V0 to VX (including)
                     // in memory starting at address I
-                    std::memcpy(
-                        memory.data() + I,
-                        V.data(),
-                        X + 1
-                    );
+                    for (size_t i{ 0 }; i <= X; ++i) {
+                        memory.write(I + i, V[i]);
+                    }
+                    mark_pages(I, X + 1);
                     pc += 2;
                     break;
                 case 0x0065:
                     // FX65 - Fills from V0 to VX (including)
                     // with values from memory at address I
-                    std::memcpy(
-                        V.data(),
-                        memory.data() + I,
-                        X + 1
-                    );
+                    for (size_t i{ 0 }; i <= X; ++i) {
+                        V[i] = memory.read(I + i);
+                    }
                     pc += 2;
                     break;
                 default:
-                    unknown_opcode(opcode);
+                    halt(Fault::unknown_opcode);
             }
             break;
 
         default:
-            unknown_opcode(opcode);
+            halt(Fault::unknown_opcode);
     }
 
 }
@@ -1,24 +1,42 @@
 #pragma once
+#include "Buzzer.hpp"
 #include <cstdint>
 #include <array>
+#include <memory>
 #include <span>
 #include <cstring>
 #include <cassert>
 #include <algorithm>
-#include <random>
 #include <sstream>
 #include <iomanip>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <fmt/format.h>
 
 using Byte = unsigned char;
 using Short = std::uint16_t;
 
-inline Byte rand_byte() {
-    static std::mt19937 gen{};
-    return std::uniform_int_distribution<Byte>{}(gen);
-}
+// Per-instance PRNG (xorshift64*).
+// Small enough to be copied along with the rest of the state.
+struct Rng {
+    static constexpr std::uint64_t default_seed{ 0x9E3779B97F4A7C15ull };
+    std::uint64_t state{ default_seed };
+
+    void seed(std::uint64_t s) noexcept {
+        // Zero is the one state xorshift can't leave
+        state = s ? s : default_seed;
+    }
+
+    Byte next_byte() noexcept {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return static_cast<Byte>((state * 0x2545F4914F6CDD1Dull) >> 56);
+    }
+};
 
 // LE <-> BE conversion
 inline Short byte_swap(Short val) noexcept {
@@ -31,14 +49,66 @@ struct Chip8Base {
     // Total 4k of memory (0x000-0xFFF)
     // 0x000-0x1FF - Chip8 interpreter / Internal data
     // 0x200-0xFFF - Program RAM
-    std::array<Byte, 4096u> memory{};
-    std::span<Byte, 80u> fonts{
-        memory.data(), 80ull
-    };
-    std::span<Byte, (0x1000-0x200)> RAM{
-        memory.begin() + 0x200, memory.end()
+    static constexpr size_t memory_size{ 4096u };
+    static constexpr Short font_address{ 0x000 };
+    static constexpr Short program_address{ 0x200 };
+
+    // Memory is split into pages of this size for
+    // copy-on-write sharing and dirty tracking
+    static constexpr size_t page_size{ 256u };
+    static constexpr size_t page_count{ memory_size / page_size };
+
+    // Paged memory over a read-only image shared between instances.
+    // A page gets a private copy only when it's first written to,
+    // so instances of one ROM share everything they don't modify.
+    // Addresses wrap around at 4k.
+    class Memory {
+    public:
+        using Page = std::array<Byte, page_size>;
+        using Image = std::array<Page, page_count>;
+
+    private:
+        std::shared_ptr<const Image> image_;
+        // Either a page of the image or a privately owned page
+        std::array<const Byte*, page_count> pages_{};
+        std::uint16_t owned_{ 0 };
+
+    public:
+        explicit Memory(std::shared_ptr<const Image> image) noexcept;
+
+        Memory(const Memory& other);
+        Memory& operator=(const Memory& other);
+        Memory(Memory&& other) noexcept;
+        Memory& operator=(Memory&& other) noexcept;
+        ~Memory();
+
+        Byte read(size_t addr) const noexcept {
+            return pages_[(addr / page_size) % page_count][addr % page_size];
+        }
+
+        // Allocates a private copy of the page on its first write
+        void write(size_t addr, Byte value) {
+            writable_page((addr / page_size) % page_count)[addr % page_size] = value;
+        }
+
+        const std::shared_ptr<const Image>& image() const noexcept { return image_; }
+        std::uint16_t owned_pages() const noexcept { return owned_; }
+
+        // Make page p hold the same bytes as in src
+        void copy_page_from(const Memory& src, size_t p);
+
+        void copy_to(std::span<Byte, memory_size> out) const noexcept;
+        // Only pages that differ from the image become private
+        void assign(std::span<const Byte, memory_size> in);
+
+    private:
+        Byte* writable_page(size_t p);
+        void release(size_t p) noexcept;
+        void release_all() noexcept;
     };
 
+    Memory memory;
+
     // 15 8-bit registers V1..VE and
     // a 'carry flag' register VF
     std::array<Byte, 16u> V{};
@@ -50,15 +120,20 @@ struct Chip8Base {
     Short I{};
 
     // Program Counter
-    Short pc{ 0x200 };
+    Short pc{ program_address };
 
     // Screen B/W
     // Width: 64px, Height: 32px
+    // One 64-bit word per row, leftmost pixel in the MSB
     static constexpr size_t fb_width{ 64u };
     static constexpr size_t fb_height{ 32u };
-    using framebuffer_t = std::array<Byte, fb_width * fb_height>;
+    using framebuffer_t = std::array<std::uint64_t, fb_height>;
     framebuffer_t frame{};
 
+    static bool pixel(const framebuffer_t& fb, size_t x, size_t y) noexcept {
+        return (fb[y] >> (fb_width - 1 - x)) & 1u;
+    }
+
     // Hardware timers
     Byte delay_timer{};
     Byte sound_timer{};
@@ -69,59 +144,153 @@ struct Chip8Base {
         std::array<Short, 16u> stack_{};
         Byte sp_{};
 
+        friend class Chip8;
+
     public:
-        void push(Short pc) noexcept {
+        // False if the stack is full
+        bool push(Short pc) noexcept {
+            if (sp_ >= stack_.size()) { return false; }
             stack_[sp_] = pc;
             ++sp_;
+            return true;
         }
-        Short pop() noexcept {
+        // False if the stack is empty
+        bool pop(Short& pc) noexcept {
+            if (sp_ == 0 || sp_ > stack_.size()) { return false; }
             --sp_;
-            return stack_[sp_];
+            pc = stack_[sp_];
+            return true;
         }
     };
 
     CallStack stack{};
 
-    // Hex Keypad
-    std::array<Byte, 16u> key{};
+    // Hex Keypad, one bit per key
+    std::uint16_t keys{};
+
+    // Source for CXNN
+    Rng rng{};
+
+    // Why the interpreter halted. A faulted machine
+    // stays put until its state is replaced.
+    enum class Fault : Byte {
+        none,
+        unknown_opcode,
+        stack_overflow,
+        stack_underflow,
+    };
+
+    Fault fault{ Fault::none };
+
+    explicit Chip8Base(std::shared_ptr<const Memory::Image> image) noexcept :
+        memory{ std::move(image) }
+    {}
 
 };
 
 
 
+// Flat copy of the complete machine state.
+// Trivially copyable and free of padding, so it can be
+// hashed, diffed and compared as raw bytes.
+struct Snapshot {
+    std::uint64_t rng{};
+    std::uint64_t cycle_count{};
+
+    Chip8Base::framebuffer_t frame{};
+    std::array<Byte, Chip8Base::memory_size> memory{};
+    std::array<Byte, 16u> V{};
+    std::array<Short, 16u> stack{};
+
+    Short opcode{};
+    Short I{};
+    Short pc{};
+    std::uint16_t keys{};
+
+    Byte sp{};
+    Byte delay_timer{};
+    Byte sound_timer{};
+    Byte draw_flag{};
+    Byte buzzing{};
+    Byte fault{};
+
+    std::array<Byte, 2u> reserved{};
+};
+
+static_assert(std::has_unique_object_representations_v<Snapshot>);
+
+
+
 class Chip8 : private Chip8Base {
 private:
     bool draw_flag{ false };
     static const std::array<Byte, 80> fontset;
 
 public:
-    Chip8() noexcept {
-        init_fontset();
-    }
+    using Chip8Base::Memory;
+    using MemoryImage = Memory::Image;
+    using Chip8Base::Fault;
+
+private:
+    // Number of executed emulate_cycle() calls
+    std::uint64_t cycle_count{ 0 };
 
-    void emulate_cycle() noexcept {
+    // Buzzer output, optional
+    BuzzerQueue* buzzer_queue{ nullptr };
+    bool buzzing{ false };
+
+    // Memory pages and framebuffer rows written since mark_baseline()
+    std::uint16_t dirty_pages{ 0 };
+    std::uint32_t dirty_rows{ 0 };
+    static_assert(page_count <= 16 && fb_height <= 32);
+
+public:
+    // Starts with just the fontset in memory
+    Chip8() noexcept :
+        Chip8Base{ empty_image() }
+    {}
+
+    // Does nothing once faulted. The first write to a page still
+    // shared with the image allocates, so this can throw std::bad_alloc.
+    void emulate_cycle() {
+        if (fault != Fault::none) { return; }
 
         // Note: Big-endian
-        opcode = memory[pc] << 8 | memory[pc + 1];
+        opcode = memory.read(pc) << 8 | memory.read(pc + 1u);
 
         decode_opcode();
 
+        ++cycle_count;
     }
 
     void update_timers() noexcept {
         if (delay_timer) { --delay_timer; }
 
         if (sound_timer) {
-            // Make sound?
             --sound_timer;
         }
+        update_buzzer();
     }
 
-    void load_program(std::span<Byte> program) noexcept {
-        std::memcpy(RAM.data(), program.data(), program.size());
+    // Replace memory with the fontset and program.
+    // Programs larger than the program RAM are cut off.
+    void load_program(std::span<const Byte> program) {
+        load_image(make_image(program));
     }
 
+    // Replace memory with a shared image made by make_image().
+    // Instances loaded from one image share its unmodified pages.
+    void load_image(std::shared_ptr<const MemoryImage> image) noexcept {
+        memory = Memory{ std::move(image) };
+        dirty_pages = static_cast<std::uint16_t>((1u << page_count) - 1);
+    }
+
+    static std::shared_ptr<const MemoryImage> make_image(std::span<const Byte> program);
+
+    const Memory& get_memory() const noexcept { return memory; }
+
     using Chip8Base::framebuffer_t;
+    using Chip8Base::pixel;
     const framebuffer_t& framebuffer() const noexcept {
         return frame;
     }
@@ -134,20 +303,106 @@ public:
     const decltype(V)& get_registers() const noexcept { return V; }
     Short get_index() const noexcept { return I; }
     Short get_pc() const noexcept { return pc; }
+    Byte peek(Short addr) const noexcept { return memory.read(addr); }
+    std::uint64_t get_cycle_count() const noexcept { return cycle_count; }
+    Byte get_stack_depth() const noexcept { return stack.sp_; }
+
+    // Fault::none while running. pc and opcode are
+    // left at the instruction that faulted.
+    Fault get_fault() const noexcept { return fault; }
+
+    // Emit buzzer on/off events into the queue (nullptr to detach).
+    // Events are dropped if the consumer falls behind.
+    void set_buzzer_queue(BuzzerQueue* queue) noexcept { buzzer_queue = queue; }
+    bool is_buzzing() const noexcept { return buzzing; }
+
+    void key_press(Byte id) noexcept { keys |= 1u << (id & 0xF); }
+    void key_release(Byte id) noexcept { keys &= ~(1u << (id & 0xF)); }
+    bool is_pressed(Byte id) const noexcept { return keys & (1u << (id & 0xF)); }
+    std::uint16_t get_keys() const noexcept { return keys; }
+
+    void seed(std::uint64_t s) noexcept { rng.seed(s); }
+
+    // Capture or restore the complete state.
+    // The buzzer queue is not part of the state and is kept as is.
+    void save_state(Snapshot& out) const noexcept;
+    void load_state(const Snapshot& in);
+
+    Snapshot snapshot() const noexcept {
+        Snapshot s;
+        save_state(s);
+        return s;
+    }
+
+
+    // Dirty tracking for cheap reset and cloning.
+    //
+    // mark_baseline() forgets all writes so far. Instances copied
+    // from one baseline can then be reset or forked into each other
+    // by copying only the memory pages and framebuffer rows either
+    // of them wrote since. load_state() counts as writing everything.
+    void mark_baseline() noexcept {
+        dirty_pages = 0;
+        dirty_rows = 0;
+    }
+
+    std::uint16_t get_dirty_pages() const noexcept { return dirty_pages; }
+    std::uint32_t get_dirty_rows() const noexcept { return dirty_rows; }
+
+    // Make this an exact copy of src. Both must descend from
+    // the same baseline. The buzzer queue is not copied.
+    void copy_dirty_from(const Chip8& src);
+
+    // Return to the state of the baseline instance.
+    void reset_to(const Chip8& baseline) { copy_dirty_from(baseline); }
 
-    void key_press(Byte id) noexcept { key[id] = 1; }
-    void key_release(Byte id) noexcept { key[id] = 0; }
-    const decltype(key)& get_keys() const noexcept { return key; }
 private:
-    void decode_opcode() noexcept;
+    void decode_opcode();
+
+    void mark_pages(size_t addr, size_t size) noexcept {
+        if (!size) { return; }
+        const size_t first{ (addr / page_size) % page_count };
+        const size_t last{ ((addr + size - 1) / page_size) % page_count };
+        for (size_t page{ first }; ; page = (page + 1) % page_count) {
+            dirty_pages |= 1u << page;
+            if (page == last) { break; }
+        }
+    }
+
+    void mark_row(size_t row) noexcept {
+        dirty_rows |= 1u << (row % fb_height);
+    }
 
-    void unknown_opcode(Short op) {
-        throw std::runtime_error{ fmt::format("Unknown opcode: {:#06x}", op) };
+    void update_buzzer() noexcept {
+        const bool on{ sound_timer != 0 };
+        if (on == buzzing) { return; }
+        buzzing = on;
+
+        if (buzzer_queue) {
+            BuzzerEvent event{};
+            event.kind = on ? BuzzerEvent::Kind::on : BuzzerEvent::Kind::off;
+            event.cycle = cycle_count;
+            event.emitted = std::chrono::steady_clock::now();
+            buzzer_queue->try_push(event);
+        }
     }
-    void init_fontset() noexcept {
-        std::memcpy(
-            memory.data(), fontset.data(), fontset.size()
-        );
+
+    void halt(Fault f) noexcept {
+        fault = f;
     }
 
+    static const std::shared_ptr<const MemoryImage>& empty_image();
+
 };
+
+
+
+inline std::string_view to_string(Chip8::Fault f) noexcept {
+    switch (f) {
+        case Chip8::Fault::none: return "none";
+        case Chip8::Fault::unknown_opcode: return "unknown opcode";
+        case Chip8::Fault::stack_overflow: return "stack overflow";
+        case Chip8::Fault::stack_underflow: return "stack underflow";
+    }
+    return "invalid fault";
+}
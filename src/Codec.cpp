@@ -0,0 +1,155 @@
+#include "Codec.hpp"
+#include <cassert>
+
+
+
+void codec::encode_xor(
+    std::span<const byte_t> base,
+    std::span<const byte_t> target,
+    std::vector<byte_t>& out
+) {
+    assert(base.size() == target.size());
+
+    const size_t size{ target.size() };
+    size_t pos{ 0 };
+
+    while (pos < size) {
+        const size_t run_start{ pos };
+        while (pos < size && base[pos] == target[pos]) { ++pos; }
+        if (pos == size) { break; } // Trailing equal run is implicit
+
+        const size_t equal_run{ pos - run_start };
+
+        // Extend the diff run over short equal gaps,
+        // a new token would cost more than the gap
+        const size_t diff_start{ pos };
+        size_t diff_end{ pos };
+        while (pos < size) {
+            if (base[pos] != target[pos]) {
+                diff_end = ++pos;
+                continue;
+            }
+            size_t gap{ pos };
+            while (gap < size && gap - pos < 3 && base[gap] == target[gap]) { ++gap; }
+            if (gap == size || gap - pos >= 3) { break; }
+            pos = gap;
+        }
+        pos = diff_end;
+
+        put_varint(out, equal_run);
+        put_varint(out, diff_end - diff_start);
+        for (size_t i{ diff_start }; i < diff_end; ++i) {
+            out.push_back(base[i] ^ target[i]);
+        }
+    }
+}
+
+
+
+bool codec::apply_xor(std::span<const byte_t> delta, std::span<byte_t> buf) noexcept {
+
+    size_t in{ 0 };
+    size_t pos{ 0 };
+
+    while (in < delta.size()) {
+        auto equal_run = get_varint(delta, in);
+        if (!equal_run) { return false; }
+        auto diff_run = get_varint(delta, in);
+        if (!diff_run) { return false; }
+
+        if (*equal_run > buf.size() - pos) { return false; }
+        pos += *equal_run;
+
+        if (*diff_run > buf.size() - pos || *diff_run > delta.size() - in) {
+            return false;
+        }
+        for (size_t i{ 0 }; i < *diff_run; ++i) {
+            buf[pos++] ^= delta[in++];
+        }
+    }
+    return true;
+}
+
+
+
+namespace {
+
+constexpr size_t min_match{ 4 };
+constexpr unsigned hash_bits{ 14 };
+
+std::uint32_t load4(const codec::byte_t* p) noexcept {
+    return std::uint32_t{ p[0] } | std::uint32_t{ p[1] } << 8 |
+        std::uint32_t{ p[2] } << 16 | std::uint32_t{ p[3] } << 24;
+}
+
+} // namespace
+
+
+void codec::compress(std::span<const byte_t> in, std::vector<byte_t>& out) {
+
+    // Last position + 1 of each hashed 4 bytes, 0 if none yet
+    std::vector<std::uint32_t> table(size_t{ 1 } << hash_bits, 0);
+
+    const size_t size{ in.size() };
+    size_t pos{ 0 };
+    size_t literals{ 0 };
+
+    auto put_literals = [&](size_t end) {
+        put_varint(out, end - literals);
+        out.insert(out.end(), in.begin() + literals, in.begin() + end);
+    };
+
+    while (pos + min_match <= size) {
+        const std::uint32_t v{ load4(&in[pos]) };
+        const std::uint32_t h{ (v * 2654435761u) >> (32 - hash_bits) };
+        const size_t candidate{ table[h] };
+        table[h] = static_cast<std::uint32_t>(pos + 1);
+
+        if (!candidate || load4(&in[candidate - 1]) != v) {
+            ++pos;
+            continue;
+        }
+
+        const size_t from{ candidate - 1 };
+        size_t length{ min_match };
+        while (pos + length < size && in[from + length] == in[pos + length]) { ++length; }
+
+        put_literals(pos);
+        put_varint(out, length - min_match);
+        put_varint(out, pos - from);
+        pos += length;
+        literals = pos;
+    }
+    put_literals(size);
+}
+
+
+
+bool codec::decompress(std::span<const byte_t> in, std::span<byte_t> out) noexcept {
+
+    size_t pos{ 0 };
+    size_t at{ 0 };
+
+    for (;;) {
+        const auto literals = get_varint(in, pos);
+        if (!literals || *literals > in.size() - pos || *literals > out.size() - at) {
+            return false;
+        }
+        for (size_t i{ 0 }; i < *literals; ++i) {
+            out[at++] = in[pos++];
+        }
+        if (pos == in.size()) { return at == out.size(); }
+
+        const auto length = get_varint(in, pos);
+        const auto distance = get_varint(in, pos);
+        if (!length || !distance || *distance == 0 || *distance > at ||
+            out.size() - at < min_match || *length > out.size() - at - min_match)
+        {
+            return false;
+        }
+        // Byte by byte, the match may overlap what it produces
+        for (size_t i{ 0 }; i < *length + min_match; ++i, ++at) {
+            out[at] = out[at - *distance];
+        }
+    }
+}
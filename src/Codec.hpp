@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+
+// Small byte-level codecs shared by the save state,
+// recording and streaming formats.
+namespace codec {
+
+using byte_t = unsigned char;
+
+
+// LEB128 unsigned varint
+inline void put_varint(std::vector<byte_t>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<byte_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<byte_t>(value));
+}
+
+// Reads a varint at pos and advances it.
+// Returns nullopt on truncated or overlong input.
+inline std::optional<std::uint64_t> get_varint(
+    std::span<const byte_t> in, size_t& pos
+) noexcept {
+    std::uint64_t value{ 0 };
+    for (unsigned shift{ 0 }; shift < 64; shift += 7) {
+        if (pos >= in.size()) { return {}; }
+        const byte_t b{ in[pos++] };
+        value |= std::uint64_t{ b & 0x7Fu } << shift;
+        if (!(b & 0x80)) { return value; }
+    }
+    return {};
+}
+
+
+// Zig-zag mapping for signed varints
+inline std::uint64_t zigzag(std::int64_t v) noexcept {
+    return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+}
+inline std::int64_t unzigzag(std::uint64_t v) noexcept {
+    return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+}
+
+
+// 64-bit FNV-1a
+inline std::uint64_t fnv1a(
+    std::span<const byte_t> data,
+    std::uint64_t hash = 0xCBF29CE484222325ull
+) noexcept {
+    for (byte_t b : data) {
+        hash ^= b;
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+
+// XOR delta of two equally sized buffers, run-length encoded
+// as (varint equal_run, varint diff_run, diff_run XOR bytes)*.
+// Appends to out. Identical buffers encode to nothing.
+void encode_xor(
+    std::span<const byte_t> base,
+    std::span<const byte_t> target,
+    std::vector<byte_t>& out
+);
+
+// Applies a delta produced by encode_xor() to buf in place.
+// Applying it to base yields target, and vice versa.
+// Returns false if the delta is malformed or out of bounds.
+bool apply_xor(std::span<const byte_t> delta, std::span<byte_t> buf) noexcept;
+
+
+// Greedy LZ77 with matches of at least 4 bytes anywhere behind,
+// encoded as (varint literal count, literals, varint match length - 4,
+// varint distance)* and a final literal run. Appends to out.
+void compress(std::span<const byte_t> in, std::vector<byte_t>& out);
+
+// Decodes compress() output into out, which must be exactly
+// the size of the original. Returns false if the input is malformed
+// or doesn't fill out exactly.
+bool decompress(std::span<const byte_t> in, std::span<byte_t> out) noexcept;
+
+
+} // namespace codec
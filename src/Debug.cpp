@@ -21,8 +21,7 @@ void debug::print_fb(const Chip8::framebuffer_t& fb, Short opcode) {
     fmt::print("   0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF\n\n");
     for (size_t line{ 0 }; line < Chip8Base::fb_height; ++line) {
         for (size_t col{ 0 }; col < line_buf.size(); ++col) {
-            size_t pos{ line * fb_width + col };
-            line_buf[col] = fb[pos] ? 'X' : '.';
+            line_buf[col] = Chip8::pixel(fb, col, line) ? 'X' : '.';
         }
         fmt::print("{:2} {}\n", to_hex_char(line), line_buf);
     }
@@ -32,12 +31,11 @@ void debug::print_fb(const Chip8::framebuffer_t& fb, Short opcode) {
 
 
 
-void debug::print_keypad(const std::array<Byte, 16u>& keypad) {
+void debug::print_keypad(std::uint16_t keypad) {
     thread_local std::array<char, 16u> buffer{};
-    assert(keypad.size() == buffer.size());
     fmt::print("0123456789ABCDEF\n");
     for (size_t i{ 0 }; i < buffer.size(); ++i) {
-        buffer[i] = keypad[i] ? 'X' : '.';
+        buffer[i] = (keypad & (1u << i)) ? 'X' : '.';
     }
     std::string_view sv{ buffer.begin(), buffer.end() };
     fmt::print("{}\n", sv);
@@ -47,15 +45,7 @@ void debug::print_keypad(const std::array<Byte, 16u>& keypad) {
 
 
 
-void debug::pretty_print_state(const Chip8& c8) {
-
-    Short opcode = c8.get_opcode();
-
-    struct OpcodeInfo {
-        std::string_view name{ "???" };
-        std::string_view pattern{ "" };
-        std::string_view desc{ "" };
-    };
+debug::OpcodeInfo debug::disassemble(Short opcode) noexcept {
 
     OpcodeInfo info{};
 
@@ -117,12 +107,7 @@ void debug::pretty_print_state(const Chip8& c8) {
             break;
 
         case 0x8000:
-            switch (
-                // Thanks based C++17 init-statements
-                Byte X = (opcode & 0x0F00) >> 8,
-                Y = (opcode & 0x00F0) >> 4;
-                opcode & 0x000F
-            ) {
+            switch (opcode & 0x000F) {
                 case 0x0000:
                     // 8XY0 - Set VX to the value of VY
                     info = { "SET", "8XY0", "Set VX to the value of VY" };
@@ -168,6 +153,7 @@ void debug::pretty_print_state(const Chip8& c8) {
                 default:
                     break;
             }
+            break;
 
         case 0x9000:
             switch (opcode & 0x000F) {
@@ -204,10 +190,7 @@ void debug::pretty_print_state(const Chip8& c8) {
             break;
 
         case 0xE000:
-            switch (
-                Byte X = (opcode & 0x0F00) >> 8;
-                opcode & 0x00FF
-            ) {
+            switch (opcode & 0x00FF) {
                 case 0x009E:
                     // EX9E - Skip next instr.
                     // if key in VX is pressed
@@ -224,10 +207,7 @@ void debug::pretty_print_state(const Chip8& c8) {
             break;
 
         case 0xF000:
-            switch (
-                Byte X = (opcode & 0x0F00) >> 8;
-                opcode & 0x00FF
-            ) {
+            switch (opcode & 0x00FF) {
                 case 0x0007:
                     // FX07 - Set VX to the value
                     // of the delay timer
@@ -281,6 +261,18 @@ void debug::pretty_print_state(const Chip8& c8) {
             break;
     }
 
+    return info;
+}
+
+
+
+
+
+void debug::pretty_print_state(const Chip8& c8) {
+
+    const Short opcode{ c8.get_opcode() };
+    const OpcodeInfo info{ disassemble(opcode) };
+
     fmt::print(
         "[{:#06X}] PC={:04X} I={:04X} V[{:02X}]    {:10} {:8}  {} \n",
         opcode,
@@ -1,15 +1,26 @@
 #pragma once
 #include "Chip8.hpp"
+#include <string_view>
 
 
 namespace debug {
 
 
+struct OpcodeInfo {
+    std::string_view name{ "???" };
+    std::string_view pattern{ "" };
+    std::string_view desc{ "" };
+};
+
+// Mnemonic, pattern and description of an opcode,
+// "???" for opcodes the interpreter doesn't know
+OpcodeInfo disassemble(Short opcode) noexcept;
+
 // Print the framebuffer (draw) in the console
 void print_fb(const Chip8::framebuffer_t& fb, Short opcode);
 
-// Print the state of the hexadecimal keypad
-void print_keypad(const std::array<Byte, 16u>& keypad);
+// Print the state of the hexadecimal keypad (one bit per key)
+void print_keypad(std::uint16_t keypad);
 
 // Print extensive information about the current state
 // of the chip8: registers, pc, current opcode (disassemble)
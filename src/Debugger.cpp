@@ -0,0 +1,401 @@
+#include "Debugger.hpp"
+#include "Debug.hpp"
+#include "Parse.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+
+namespace {
+
+constexpr std::string_view help{
+    "Commands:\n"
+    "    c                      Continue\n"
+    "    s                      Step one instruction\n"
+    "    n                      Step over a 2NNN call\n"
+    "    o                      Step out of the current subroutine (to after its 00EE)\n"
+    "    b <addr> [if <cond>]   Break at addr, cond is '<probe> <op> <value>'\n"
+    "                           with probe V<x>, I or mem:<addr> and op == != < <= > >=\n"
+    "    d <addr>               Delete breakpoints at addr\n"
+    "    w <addr> [len] [r|w]   Watch reads and/or writes (default both)\n"
+    "    u <addr> [len]         Stop watching\n"
+    "    l                      List breakpoints and watchpoints\n"
+    "    p                      Print the state\n"
+    "    x <addr> [len]         Dump memory\n"
+    "    i [addr] [count]       Disassemble, from pc by default\n"
+    "    q                      Quit\n"
+    "Addresses are hex.\n"
+};
+
+
+Short parse_address(const std::string& token) {
+    size_t used{ 0 };
+    const auto value = std::stoul(token, &used, 16);
+    if (used != token.size() || value >= Chip8Base::memory_size) {
+        throw std::invalid_argument{ "Invalid address: " + token };
+    }
+    return static_cast<Short>(value);
+}
+
+size_t parse_count(const std::string& token) {
+    size_t used{ 0 };
+    const auto value = std::stoul(token, &used, 0);
+    if (used != token.size() || value == 0 || value > Chip8Base::memory_size) {
+        throw std::invalid_argument{ "Invalid count: " + token };
+    }
+    return value;
+}
+
+
+Short opcode_at(const Chip8& c8, Short addr) noexcept {
+    return static_cast<Short>(c8.peek(addr) << 8 | c8.peek(static_cast<Short>(addr + 1u)));
+}
+
+
+void print_instruction(const Chip8& c8, Short addr, std::string_view marks) {
+    const Short opcode{ opcode_at(c8, addr) };
+    const debug::OpcodeInfo info{ debug::disassemble(opcode) };
+    fmt::print("{:2} {:03X}: {:04X}  {:8} {:5} {}\n",
+        marks, addr, opcode, info.name, info.pattern, info.desc);
+}
+
+
+void print_state(const Chip8& c8) {
+    const Snapshot s{ c8.snapshot() };
+    fmt::print(
+        "PC={:03X} I={:03X} SP={} DT={:02X} ST={:02X} cycle={}\n"
+        "V[{:02X}]\n",
+        s.pc, s.I, s.sp, s.delay_timer, s.sound_timer, s.cycle_count,
+        fmt::join(s.V, ",")
+    );
+    if (s.sp) {
+        fmt::print("stack[{:03X}]\n", fmt::join(s.stack.begin(), s.stack.begin() + s.sp, ","));
+    }
+    if (c8.get_fault() != Chip8::Fault::none) {
+        fmt::print("Halted on {}\n", to_string(c8.get_fault()));
+    }
+}
+
+
+std::string_view access_name(Debugger::Access access) noexcept {
+    switch (access) {
+        case Debugger::Access::read: return "read";
+        case Debugger::Access::write: return "write";
+        case Debugger::Access::both: return "read/write";
+    }
+    return "";
+}
+
+} // namespace
+
+
+
+
+Debugger::Condition Debugger::Condition::parse(std::string_view spec) {
+    // Two character operators first, '<' is a prefix of '<='
+    constexpr std::array<std::pair<std::string_view, Op>, 6> ops{ {
+        { "==", Op::eq }, { "!=", Op::ne }, { "<=", Op::le },
+        { ">=", Op::ge }, { "<", Op::lt }, { ">", Op::gt },
+    } };
+
+    for (const auto& [token, op] : ops) {
+        const auto at = spec.find(token);
+        if (at == std::string_view::npos) { continue; }
+
+        const std::string value{ text::trim(spec.substr(at + token.size())) };
+        size_t used{ 0 };
+        unsigned long parsed{ 0 };
+        try {
+            parsed = std::stoul(value, &used, 0);
+        } catch (const std::logic_error&) {}
+        if (value.empty() || used != value.size() || parsed > 0xFFFF) {
+            throw std::invalid_argument{ fmt::format("Invalid value: '{}'", value) };
+        }
+        return Condition{
+            Probe::parse(spec.substr(0, at)), op, static_cast<std::uint16_t>(parsed), std::string{ text::trim(spec) }
+        };
+    }
+    throw std::invalid_argument{ fmt::format("Invalid condition: '{}'", spec) };
+}
+
+
+bool Debugger::Condition::holds(const Chip8& c8) const noexcept {
+    const std::uint16_t v{ probe.read(c8) };
+    switch (op) {
+        case Op::eq: return v == value;
+        case Op::ne: return v != value;
+        case Op::lt: return v < value;
+        case Op::le: return v <= value;
+        case Op::gt: return v > value;
+        case Op::ge: return v >= value;
+    }
+    return false;
+}
+
+
+
+
+
+Debugger::Debugger(bool paused) noexcept :
+    mode_{ paused ? Mode::step : Mode::run }
+{
+    update_armed();
+}
+
+
+void Debugger::add_breakpoint(Breakpoint bp) {
+    bp.address %= address_count;
+    break_at_.set(bp.address);
+    breakpoints_.push_back(std::move(bp));
+    update_armed();
+}
+
+
+void Debugger::remove_breakpoints(Short address) {
+    address %= address_count;
+    std::erase_if(breakpoints_, [&](const Breakpoint& bp) { return bp.address == address; });
+    break_at_.reset(address);
+    update_armed();
+}
+
+
+void Debugger::watch(Short address, size_t size, Access access) {
+    for (size_t i{ 0 }; i < size; ++i) {
+        const size_t at{ (address + i) % address_count };
+        if (static_cast<Byte>(access) & static_cast<Byte>(Access::read)) { watch_read_.set(at); }
+        if (static_cast<Byte>(access) & static_cast<Byte>(Access::write)) { watch_write_.set(at); }
+    }
+    update_armed();
+}
+
+
+void Debugger::unwatch(Short address, size_t size) {
+    for (size_t i{ 0 }; i < size; ++i) {
+        const size_t at{ (address + i) % address_count };
+        watch_read_.reset(at);
+        watch_write_.reset(at);
+    }
+    update_armed();
+}
+
+
+void Debugger::update_armed() noexcept {
+    watching_ = watch_read_.any() || watch_write_.any();
+    armed_ = mode_ != Mode::run || !breakpoints_.empty() || watching_;
+}
+
+
+void Debugger::resume(const Chip8& c8, Mode mode) noexcept {
+    mode_ = mode;
+    resumed_at_ = c8.get_cycle_count();
+
+    if (mode == Mode::step_over) {
+        if ((opcode_at(c8, c8.get_pc()) & 0xF000) == 0x2000) {
+            target_pc_ = static_cast<Short>(c8.get_pc() + 2u);
+            target_depth_ = c8.get_stack_depth();
+        } else {
+            mode_ = Mode::step;
+        }
+    } else if (mode == Mode::step_out) {
+        target_depth_ = c8.get_stack_depth();
+        if (target_depth_ == 0) {
+            fmt::print("Not in a subroutine\n");
+            mode_ = Mode::run;
+        }
+    }
+    update_armed();
+}
+
+
+
+bool Debugger::check(const Chip8& c8) noexcept {
+    const std::uint64_t cycle{ c8.get_cycle_count() };
+    if (resumed_at_) {
+        if (*resumed_at_ == cycle) { return false; }
+        resumed_at_.reset();
+    }
+
+    const Short pc{ static_cast<Short>(c8.get_pc() % address_count) };
+    switch (mode_) {
+        case Mode::run:
+            break;
+        case Mode::step:
+            return true;
+        case Mode::step_over:
+            if (pc == target_pc_ && c8.get_stack_depth() == target_depth_) { return true; }
+            break;
+        case Mode::step_out:
+            if (c8.get_stack_depth() < target_depth_) { return true; }
+            break;
+    }
+
+    if (break_at_.test(pc)) {
+        for (const auto& bp : breakpoints_) {
+            if (bp.address == pc && (!bp.condition || bp.condition->holds(c8))) { return true; }
+        }
+    }
+
+    return watching_ && watch_hit(c8);
+}
+
+
+std::optional<std::pair<Short, Debugger::Access>> Debugger::watch_hit(const Chip8& c8) const noexcept {
+    const Short opcode{ opcode_at(c8, c8.get_pc()) };
+    const size_t X{ (opcode & 0x0F00u) >> 8 };
+
+    size_t size{ 0 };
+    Access access{ Access::read };
+    if ((opcode & 0xF000) == 0xD000) {
+        size = opcode & 0x000F;
+    } else if ((opcode & 0xF0FF) == 0xF065) {
+        size = X + 1;
+    } else if ((opcode & 0xF0FF) == 0xF055) {
+        size = X + 1;
+        access = Access::write;
+    } else if ((opcode & 0xF0FF) == 0xF033) {
+        size = 3;
+        access = Access::write;
+    }
+
+    const auto& watched = access == Access::read ? watch_read_ : watch_write_;
+    for (size_t i{ 0 }; i < size; ++i) {
+        const size_t at{ (c8.get_index() + i) % address_count };
+        if (watched.test(at)) { return std::pair{ static_cast<Short>(at), access }; }
+    }
+    return {};
+}
+
+
+
+
+bool Debugger::prompt(const Chip8& c8, std::istream& in) {
+    const Short pc{ static_cast<Short>(c8.get_pc() % address_count) };
+
+    if (auto hit = watch_hit(c8)) {
+        fmt::print("Watchpoint: {} at {:03X}\n", access_name(hit->second), hit->first);
+    } else if (break_at_.test(pc)) {
+        fmt::print("Breakpoint at {:03X}\n", pc);
+    }
+    mode_ = Mode::run;
+    print_instruction(c8, pc, ">");
+
+    std::string line;
+    for (;;) {
+        fmt::print("(chip8) ");
+        std::fflush(stdout);
+        if (!std::getline(in, line)) {
+            // Nobody left to ask
+            breakpoints_.clear();
+            break_at_.reset();
+            watch_read_.reset();
+            watch_write_.reset();
+            resume(c8, Mode::run);
+            return true;
+        }
+
+        std::istringstream args{ line };
+        std::string command;
+        args >> command;
+        std::vector<std::string> rest;
+        for (std::string arg; args >> arg; ) { rest.push_back(arg); }
+
+        try {
+            if (command.empty()) {
+                continue;
+            } else if (command == "c") {
+                resume(c8, Mode::run);
+                return true;
+            } else if (command == "s") {
+                resume(c8, Mode::step);
+                return true;
+            } else if (command == "n") {
+                resume(c8, Mode::step_over);
+                return true;
+            } else if (command == "o") {
+                resume(c8, Mode::step_out);
+                return true;
+            } else if (command == "q") {
+                return false;
+
+            } else if (command == "b" && !rest.empty()) {
+                Breakpoint bp{ parse_address(rest[0]) };
+                const auto cond = line.find(" if ");
+                if (cond != std::string::npos) {
+                    bp.condition = Condition::parse(line.substr(cond + 4));
+                } else if (rest.size() > 1) {
+                    throw std::invalid_argument{ "Expected 'if <cond>'" };
+                }
+                add_breakpoint(std::move(bp));
+            } else if (command == "d" && rest.size() == 1) {
+                remove_breakpoints(parse_address(rest[0]));
+
+            } else if (command == "w" && !rest.empty()) {
+                size_t size{ 1 };
+                Access access{ Access::both };
+                for (size_t i{ 1 }; i < rest.size(); ++i) {
+                    if (rest[i] == "r") {
+                        access = Access::read;
+                    } else if (rest[i] == "w") {
+                        access = Access::write;
+                    } else {
+                        size = parse_count(rest[i]);
+                    }
+                }
+                watch(parse_address(rest[0]), size, access);
+            } else if (command == "u" && !rest.empty()) {
+                unwatch(parse_address(rest[0]), rest.size() > 1 ? parse_count(rest[1]) : 1);
+
+            } else if (command == "l") {
+                for (const auto& bp : breakpoints_) {
+                    if (bp.condition) {
+                        fmt::print("break {:03X} if {}\n", bp.address, bp.condition->text);
+                    } else {
+                        fmt::print("break {:03X}\n", bp.address);
+                    }
+                }
+                for (size_t at{ 0 }; at < address_count; ++at) {
+                    const bool r{ watch_read_.test(at) };
+                    const bool w{ watch_write_.test(at) };
+                    if (r || w) {
+                        fmt::print("watch {:03X} {}\n", at,
+                            access_name(static_cast<Access>(r * 1 + w * 2)));
+                    }
+                }
+
+            } else if (command == "p") {
+                print_state(c8);
+            } else if (command == "x" && !rest.empty()) {
+                const Short from{ parse_address(rest[0]) };
+                const size_t size{ rest.size() > 1 ? parse_count(rest[1]) : 16 };
+                for (size_t row{ 0 }; row < size; row += 16) {
+                    fmt::print("{:03X}:", (from + row) % address_count);
+                    for (size_t i{ row }; i < std::min(size, row + 16); ++i) {
+                        fmt::print(" {:02X}", c8.peek(static_cast<Short>((from + i) % address_count)));
+                    }
+                    fmt::print("\n");
+                }
+            } else if (command == "i") {
+                Short at{ rest.empty() ? pc : parse_address(rest[0]) };
+                const size_t count{ rest.size() > 1 ? parse_count(rest[1]) : 8 };
+                for (size_t i{ 0 }; i < count; ++i) {
+                    std::string marks;
+                    marks += at == pc ? '>' : ' ';
+                    marks += break_at_.test(at) ? '*' : ' ';
+                    print_instruction(c8, at, marks);
+                    at = static_cast<Short>((at + 2u) % address_count);
+                }
+
+            } else if (command == "h") {
+                fmt::print("{}", help);
+            } else {
+                fmt::print("Unknown command, h for help\n");
+            }
+        } catch (const std::logic_error& e) {
+            fmt::print("{}\n", e.what());
+        }
+    }
+}
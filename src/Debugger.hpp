@@ -0,0 +1,107 @@
+#pragma once
+#include "Chip8.hpp"
+#include "Probe.hpp"
+#include <bitset>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Breakpoints, watchpoints and stepping with a console UI.
+//
+// The run loop asks should_stop() before every instruction and hands
+// over to prompt() when it says so. Breakpoints and watchpoints are
+// flags in per-address bitmaps, and with nothing set should_stop()
+// is a single test of one flag, so the core runs at full speed.
+// Watchpoints trigger before the instruction that would access
+// a watched address: DXYN and FX65 read, FX33 and FX55 write.
+class Debugger {
+public:
+    // "<probe> <op> <value>" with a Probe spec and one of == != < <= > >=
+    struct Condition {
+        enum class Op { eq, ne, lt, le, gt, ge };
+
+        Probe probe;
+        Op op{ Op::eq };
+        std::uint16_t value{};
+        // As written, for listing
+        std::string text{};
+
+        // Throws std::invalid_argument on a malformed condition
+        static Condition parse(std::string_view spec);
+
+        bool holds(const Chip8& c8) const noexcept;
+    };
+
+    struct Breakpoint {
+        Short address{};
+        // Breaks every time if not set
+        std::optional<Condition> condition{};
+    };
+
+    enum class Access : Byte { read = 1, write = 2, both = 3 };
+
+private:
+    enum class Mode {
+        run,
+        // Before the next instruction
+        step,
+        // At pc with the stack as deep as now, after a 2NNN returns
+        step_over,
+        // Once the stack is shallower than now
+        step_out,
+    };
+
+    static constexpr size_t address_count{ Chip8Base::memory_size };
+
+    std::bitset<address_count> break_at_{};
+    std::vector<Breakpoint> breakpoints_{};
+
+    std::bitset<address_count> watch_read_{};
+    std::bitset<address_count> watch_write_{};
+
+    Mode mode_{ Mode::run };
+    Short target_pc_{ 0 };
+    Byte target_depth_{ 0 };
+
+    // Resuming skips whatever stopped at this cycle
+    std::optional<std::uint64_t> resumed_at_{};
+
+    bool watching_{ false };
+    // Anything at all to check
+    bool armed_{ false };
+
+public:
+    // Starts paused if true, so the first instruction goes to the prompt
+    explicit Debugger(bool paused = false) noexcept;
+
+    // True if the run loop should call prompt() before executing
+    // the instruction at pc
+    bool should_stop(const Chip8& c8) noexcept {
+        if (!armed_) { return false; }
+        return check(c8);
+    }
+
+    // Shows why execution stopped and reads commands from in
+    // until one resumes it. Returns false if the user asked to quit.
+    // End of input detaches: everything is cleared and execution resumes.
+    bool prompt(const Chip8& c8, std::istream& in);
+
+    void add_breakpoint(Breakpoint bp);
+    void remove_breakpoints(Short address);
+    void watch(Short address, size_t size, Access access);
+    void unwatch(Short address, size_t size);
+
+    const std::vector<Breakpoint>& breakpoints() const noexcept { return breakpoints_; }
+
+private:
+    bool check(const Chip8& c8) noexcept;
+    void update_armed() noexcept;
+    void resume(const Chip8& c8, Mode mode) noexcept;
+
+    // First watched address the next instruction touches, if any
+    std::optional<std::pair<Short, Access>> watch_hit(const Chip8& c8) const noexcept;
+};
@@ -0,0 +1,102 @@
+#include "Display.hpp"
+#include "Canvas.hpp"
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+
+ShmDisplay::ShmDisplay(std::string name) :
+    name_{ std::move(name) }
+{
+    const int fd{ shm_open(name_.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644) };
+    if (fd < 0) {
+        throw std::runtime_error{
+            fmt::format("Unable to create shared memory {}: {}", name_, std::strerror(errno))
+        };
+    }
+
+    void* mem{ MAP_FAILED };
+    if (ftruncate(fd, shm_ring::size) == 0) {
+        mem = mmap(nullptr, shm_ring::size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    const int error{ errno };
+    ::close(fd);
+
+    if (mem == MAP_FAILED) {
+        shm_unlink(name_.c_str());
+        throw std::runtime_error{
+            fmt::format("Unable to map shared memory {}: {}", name_, std::strerror(error))
+        };
+    }
+
+    header_ = new (mem) shm_ring::Header{
+        { shm_ring::magic[0], shm_ring::magic[1], shm_ring::magic[2], shm_ring::magic[3] },
+        shm_ring::format_version,
+        shm_ring::width, shm_ring::height,
+        shm_ring::slot_count, sizeof(shm_ring::Slot),
+        {}
+    };
+    header_->sequence.store(0, std::memory_order_relaxed);
+
+    auto* slots = shm_ring::slots(header_);
+    for (std::uint32_t i{ 0 }; i < shm_ring::slot_count; ++i) {
+        new (&slots[i]) shm_ring::Slot{};
+        slots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+
+ShmDisplay::~ShmDisplay() {
+    munmap(header_, shm_ring::size);
+    shm_unlink(name_.c_str());
+}
+
+
+void ShmDisplay::upload(const Chip8::framebuffer_t& fb) {
+    pending_ = header_->sequence.load(std::memory_order_relaxed) + 1;
+    auto& slot = shm_ring::slots(header_)[pending_ % shm_ring::slot_count];
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.timestamp_ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count()
+    );
+    static_assert(sizeof(slot.rows) == sizeof(fb));
+    std::memcpy(slot.rows.data(), fb.data(), sizeof(fb));
+
+    slot.sequence.store(pending_, std::memory_order_release);
+}
+
+
+void ShmDisplay::present() {
+    if (pending_) {
+        header_->sequence.store(pending_, std::memory_order_release);
+        pending_ = 0;
+    }
+}
+
+
+
+
+std::unique_ptr<Display> make_display(std::string_view spec) {
+
+    if (spec == "sfml") {
+        return std::make_unique<Canvas>();
+    }
+    if (spec == "null") {
+        return std::make_unique<NullDisplay>();
+    }
+    if (spec.starts_with("shm:")) {
+        return std::make_unique<ShmDisplay>(std::string{ spec.substr(4) });
+    }
+    throw std::invalid_argument{ "Unknown display: " + std::string{ spec } };
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include "Chip8.hpp"
+#include "Metrics.hpp"
+#include "Recording.hpp"
+#include "ShmRing.hpp"
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+
+// Where frames are presented and input comes from.
+// Canvas is the windowed one, the rest run headless.
+class Display {
+public:
+    // Frontend hotkeys, not forwarded to the Chip8.
+    // One-shot requests are cleared by whoever handles them.
+    struct Hotkeys {
+        bool rewind{ false };     // Held
+        bool quick_save{ false }; // One-shot
+        bool quick_load{ false }; // One-shot
+    };
+
+private:
+    Hotkeys hotkeys_{};
+
+    // Logs keypad input, optional
+    recording::Recorder* recorder_{ nullptr };
+
+    // Optional
+    metrics::Frontend* metrics_{ nullptr };
+    // Earliest key event not yet presented
+    std::optional<std::chrono::steady_clock::time_point> pending_input_{};
+
+public:
+    Display() = default;
+    Display(const Display&) = delete;
+    Display& operator=(const Display&) = delete;
+    virtual ~Display() = default;
+
+    virtual bool is_open() const = 0;
+    virtual void close() = 0;
+
+    // Forward pending input to the chip8
+    virtual void process_events(Chip8& chip8) = 0;
+
+    // Take in a new frame
+    void update(const Chip8::framebuffer_t& fb) {
+        const auto start = std::chrono::steady_clock::now();
+        upload(fb);
+        if (metrics_) {
+            metrics_->update_time.observe(std::chrono::steady_clock::now() - start);
+        }
+    }
+
+    // Show the last frame taken in
+    void redraw() {
+        const auto start = std::chrono::steady_clock::now();
+        present();
+        if (metrics_) {
+            const auto now = std::chrono::steady_clock::now();
+            metrics_->redraw_time.observe(now - start);
+            metrics_->frames_presented.add();
+            if (pending_input_) {
+                metrics_->input_latency.observe(now - *pending_input_);
+            }
+        }
+        pending_input_.reset();
+    }
+
+    Hotkeys& hotkeys() noexcept { return hotkeys_; }
+
+    void set_recorder(recording::Recorder* recorder) noexcept {
+        recorder_ = recorder;
+    }
+
+    void set_metrics(metrics::Frontend* metrics) noexcept {
+        metrics_ = metrics;
+    }
+
+protected:
+    virtual void upload(const Chip8::framebuffer_t& fb) = 0;
+    virtual void present() = 0;
+
+    void press(Chip8& chip8, Byte id) {
+        input_event();
+        if (recorder_) { recorder_->key_event(chip8.get_cycle_count(), id, true); }
+        chip8.key_press(id);
+    }
+
+    void release(Chip8& chip8, Byte id) {
+        input_event();
+        if (recorder_) { recorder_->key_event(chip8.get_cycle_count(), id, false); }
+        chip8.key_release(id);
+    }
+
+private:
+    void input_event() {
+        if (metrics_ && !pending_input_) {
+            pending_input_ = std::chrono::steady_clock::now();
+        }
+    }
+};
+
+
+
+// Drops frames, never closes by itself. For benchmarks.
+class NullDisplay final : public Display {
+private:
+    bool open_{ true };
+
+public:
+    bool is_open() const override { return open_; }
+    void close() override { open_ = false; }
+    void process_events(Chip8&) override {}
+
+protected:
+    void upload(const Chip8::framebuffer_t&) override {}
+    void present() override {}
+};
+
+
+
+// Publishes frames into a POSIX shared memory ring (see ShmRing.hpp)
+// for consumers in other processes. Never closes by itself.
+class ShmDisplay final : public Display {
+private:
+    std::string name_;
+    shm_ring::Header* header_{ nullptr };
+    // Frame being written, published by present()
+    std::uint64_t pending_{ 0 };
+    bool open_{ true };
+
+public:
+    // Name as for shm_open(), "/chip8" for example.
+    // Throws std::runtime_error if it can't be created.
+    explicit ShmDisplay(std::string name);
+    ~ShmDisplay() override;
+
+    bool is_open() const override { return open_; }
+    void close() override { open_ = false; }
+    void process_events(Chip8&) override {}
+
+protected:
+    void upload(const Chip8::framebuffer_t& fb) override;
+    void present() override;
+};
+
+
+
+// Creates a display from a spec: "sfml", "null" or "shm:<name>".
+// Throws std::invalid_argument on an unknown spec.
+std::unique_ptr<Display> make_display(std::string_view spec);
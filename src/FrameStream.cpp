@@ -0,0 +1,331 @@
+#include "FrameStream.hpp"
+#include "Codec.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+
+namespace {
+
+constexpr char magic[4]{ 'C', '8', 'F', 'S' };
+constexpr char index_magic[4]{ 'C', '8', 'F', 'I' };
+constexpr size_t header_size{ 12 };
+constexpr size_t trailer_size{ 8 };
+
+constexpr Byte kind_keyframe{ 0 };
+constexpr Byte kind_delta{ 1 };
+
+constexpr size_t flush_threshold{ 64 * 1024 };
+
+
+template<typename UInt>
+void put_le(std::vector<Byte>& out, UInt v) {
+    for (size_t i{ 0 }; i < sizeof(UInt); ++i) {
+        out.push_back(static_cast<Byte>(v >> (8 * i)));
+    }
+}
+
+template<typename UInt>
+UInt get_le(std::span<const Byte> in) noexcept {
+    UInt v{ 0 };
+    for (size_t i{ 0 }; i < sizeof(UInt); ++i) {
+        v |= static_cast<UInt>(UInt{ in[i] } << (8 * i));
+    }
+    return v;
+}
+
+
+struct Record {
+    Byte kind{};
+    std::uint64_t number{};
+    std::span<const Byte> payload{};
+    size_t next{};
+};
+
+// Nullopt if the record at pos is cut short or malformed
+std::optional<Record> parse_record(std::span<const Byte> data, size_t pos) noexcept {
+    if (pos >= data.size()) { return {}; }
+
+    Record rec{};
+    rec.kind = data[pos++];
+    if (rec.kind != kind_keyframe && rec.kind != kind_delta) { return {}; }
+
+    const auto number = codec::get_varint(data, pos);
+    const auto size = codec::get_varint(data, pos);
+    if (!number || !size || *size > data.size() - pos) { return {}; }
+
+    rec.number = *number;
+    rec.payload = data.subspan(pos, *size);
+    rec.next = pos + *size;
+    return rec;
+}
+
+} // namespace
+
+
+
+
+void framestream::pack(const Chip8::framebuffer_t& fb, Packed& out) noexcept {
+    size_t i{ 0 };
+    for (std::uint64_t row : fb) {
+        for (size_t shift{ Chip8Base::fb_width }; shift != 0; shift -= 8) {
+            out[i++] = static_cast<Byte>(row >> (shift - 8));
+        }
+    }
+}
+
+
+void framestream::unpack(const Packed& in, Chip8::framebuffer_t& fb) noexcept {
+    size_t i{ 0 };
+    for (std::uint64_t& row : fb) {
+        row = 0;
+        for (size_t byte{ 0 }; byte < Chip8Base::fb_width / 8; ++byte) {
+            row = row << 8 | in[i++];
+        }
+    }
+}
+
+
+
+
+
+framestream::Recorder::Recorder(const std::string& path, std::uint16_t keyframe_interval) :
+    file_{ path, std::ios_base::binary | std::ios_base::trunc },
+    keyframe_interval_{ keyframe_interval ? keyframe_interval : std::uint16_t{ 1 } }
+{
+    if (file_.fail()) {
+        throw std::runtime_error{ "Unable to create frame stream: " + path };
+    }
+    buffer_.reserve(2 * flush_threshold);
+
+    buffer_.insert(buffer_.end(), std::begin(magic), std::end(magic));
+    put_le(buffer_, format_version);
+    put_le(buffer_, static_cast<std::uint16_t>(Chip8Base::fb_width));
+    put_le(buffer_, static_cast<std::uint16_t>(Chip8Base::fb_height));
+    put_le(buffer_, keyframe_interval_);
+    flush();
+
+    thread_ = std::thread{ [this] { write_loop(); } };
+}
+
+
+framestream::Recorder::~Recorder() {
+    finish();
+}
+
+
+bool framestream::Recorder::push(const Chip8::framebuffer_t& fb, std::uint64_t number) noexcept {
+    if (!running_.load(std::memory_order_relaxed) || !queue_.try_push(Frame{ number, fb })) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+
+void framestream::Recorder::finish() {
+    if (!thread_.joinable()) { return; }
+
+    running_.store(false, std::memory_order_release);
+    thread_.join();
+
+    // Index and trailer
+    const std::uint64_t index_offset{ written_ + buffer_.size() };
+    buffer_.insert(buffer_.end(), std::begin(index_magic), std::end(index_magic));
+    codec::put_varint(buffer_, count_);
+    codec::put_varint(buffer_, keyframes_.size());
+    for (const auto& [ordinal, offset] : keyframes_) {
+        codec::put_varint(buffer_, ordinal);
+        codec::put_varint(buffer_, offset);
+    }
+    put_le(buffer_, index_offset);
+    flush();
+    file_.close();
+}
+
+
+void framestream::Recorder::write_loop() {
+    Frame frame{};
+    for (;;) {
+        if (queue_.try_pop(frame)) {
+            encode(frame);
+            continue;
+        }
+        // Pushes before finish() are visible once running_ is seen false
+        if (!running_.load(std::memory_order_acquire)) {
+            while (queue_.try_pop(frame)) { encode(frame); }
+            return;
+        }
+        if (buffer_.size() >= flush_threshold) {
+            flush();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 2 });
+    }
+}
+
+
+void framestream::Recorder::encode(const Frame& frame) {
+    Packed packed;
+    pack(frame.rows, packed);
+
+    const bool keyframe{ count_ % keyframe_interval_ == 0 };
+    if (keyframe) {
+        keyframes_.emplace_back(count_, written_ + buffer_.size());
+        previous_.fill(0);
+    }
+
+    buffer_.push_back(keyframe ? kind_keyframe : kind_delta);
+    codec::put_varint(buffer_, keyframe ?
+        frame.number :
+        codec::zigzag(static_cast<std::int64_t>(frame.number - last_number_))
+    );
+
+    payload_.clear();
+    codec::encode_xor(previous_, packed, payload_);
+    codec::put_varint(buffer_, payload_.size());
+    buffer_.insert(buffer_.end(), payload_.begin(), payload_.end());
+
+    previous_ = packed;
+    last_number_ = frame.number;
+    ++count_;
+}
+
+
+void framestream::Recorder::flush() {
+    file_.write(reinterpret_cast<const char*>(buffer_.data()),
+        static_cast<std::streamsize>(buffer_.size()));
+    file_.flush();
+    written_ += buffer_.size();
+    buffer_.clear();
+}
+
+
+
+
+
+framestream::Reader::Reader(const std::string& path) {
+    std::ifstream fs{ path, std::ios_base::binary };
+    if (fs.fail()) {
+        throw std::runtime_error{ "Unable to open frame stream: " + path };
+    }
+    data_.assign(std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>());
+
+    if (data_.size() < header_size || std::memcmp(data_.data(), magic, 4) != 0) {
+        throw std::runtime_error{ "Not a frame stream: " + path };
+    }
+    const std::span<const Byte> header{ data_.data(), header_size };
+    const auto version = get_le<std::uint16_t>(header.subspan(4));
+    if (version != format_version) {
+        throw std::runtime_error{
+            fmt::format("Unsupported frame stream version: {}", version)
+        };
+    }
+    if (get_le<std::uint16_t>(header.subspan(6)) != Chip8Base::fb_width ||
+        get_le<std::uint16_t>(header.subspan(8)) != Chip8Base::fb_height)
+    {
+        throw std::runtime_error{ "Unsupported frame size in " + path };
+    }
+    keyframe_interval_ = get_le<std::uint16_t>(header.subspan(10));
+
+    if (!read_index()) {
+        scan();
+    }
+    seek(0);
+}
+
+
+bool framestream::Reader::read_index() {
+    if (data_.size() < header_size + sizeof(index_magic) + trailer_size) { return false; }
+
+    const std::span<const Byte> data{ data_ };
+    const auto offset = get_le<std::uint64_t>(data.last(trailer_size));
+    if (offset < header_size || offset > data.size() - trailer_size - sizeof(index_magic) ||
+        std::memcmp(data.data() + offset, index_magic, sizeof(index_magic)) != 0)
+    {
+        return false;
+    }
+
+    size_t pos{ offset + sizeof(index_magic) };
+    const auto count = codec::get_varint(data, pos);
+    const auto keyframes = codec::get_varint(data, pos);
+    if (!count || !keyframes || *keyframes > *count) { return false; }
+
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> index;
+    for (std::uint64_t i{ 0 }; i < *keyframes; ++i) {
+        const auto ordinal = codec::get_varint(data, pos);
+        const auto where = codec::get_varint(data, pos);
+        if (!ordinal || !where || *ordinal >= *count || *where >= offset ||
+            (!index.empty() && *ordinal <= index.back().first))
+        {
+            return false;
+        }
+        index.emplace_back(*ordinal, *where);
+    }
+
+    count_ = *count;
+    keyframes_ = std::move(index);
+    end_ = offset;
+    return true;
+}
+
+
+void framestream::Reader::scan() {
+    count_ = 0;
+    keyframes_.clear();
+
+    size_t pos{ header_size };
+    while (auto rec = parse_record(data_, pos)) {
+        if (rec->kind == kind_keyframe) {
+            keyframes_.emplace_back(count_, pos);
+        } else if (keyframes_.empty()) {
+            break;
+        }
+        ++count_;
+        pos = rec->next;
+    }
+    end_ = pos;
+}
+
+
+void framestream::Reader::seek(std::uint64_t ordinal) {
+    auto it = std::upper_bound(keyframes_.begin(), keyframes_.end(), ordinal,
+        [](std::uint64_t o, const auto& kf) { return o < kf.first; });
+
+    if (it == keyframes_.begin()) {
+        pos_ = end_;
+        ordinal_ = count_;
+        return;
+    }
+    --it;
+    pos_ = it->second;
+    ordinal_ = it->first;
+
+    while (ordinal_ < ordinal && next()) {}
+}
+
+
+std::optional<framestream::Frame> framestream::Reader::next() {
+    if (ordinal_ >= count_ || pos_ >= end_) { return {}; }
+
+    auto rec = parse_record({ data_.data(), end_ }, pos_);
+    if (!rec) {
+        throw std::runtime_error{ "Malformed frame stream" };
+    }
+
+    if (rec->kind == kind_keyframe) {
+        packed_.fill(0);
+        current_.number = rec->number;
+    } else {
+        current_.number += static_cast<std::uint64_t>(codec::unzigzag(rec->number));
+    }
+    if (!codec::apply_xor(rec->payload, packed_)) {
+        throw std::runtime_error{ "Malformed frame stream" };
+    }
+    unpack(packed_, current_.rows);
+
+    pos_ = rec->next;
+    ++ordinal_;
+    return current_;
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "Chip8.hpp"
+#include "SpscQueue.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+// Compressed stream of presented frames (all integers little-endian):
+//
+//   Header: "C8FS", u16 version, u16 width, u16 height, u16 keyframe_interval
+//
+//   Frames: u8 kind (0 keyframe, 1 delta), varint emulated frame number,
+//   varint payload size, payload. The frame number is absolute for
+//   keyframes and a zig-zag delta from the previous frame otherwise.
+//   The payload is codec::encode_xor() of the packed frame against
+//   the previous one, or against a blank one for keyframes.
+//
+//   Index: "C8FI", varint frame count, varint keyframe count,
+//   then (varint frame ordinal, varint file offset) per keyframe.
+//   Trailer: u64 offset of the index.
+//
+// Packed frames are 32 rows of 8 bytes, leftmost pixel in the MSB.
+// A stream cut short has no index, the reader then scans it instead.
+namespace framestream {
+
+constexpr std::uint16_t format_version{ 1 };
+
+constexpr size_t packed_size{ Chip8Base::fb_height * Chip8Base::fb_width / 8 };
+using Packed = std::array<Byte, packed_size>;
+
+void pack(const Chip8::framebuffer_t& fb, Packed& out) noexcept;
+void unpack(const Packed& in, Chip8::framebuffer_t& fb) noexcept;
+
+
+struct Frame {
+    // Emulated frame it was presented at
+    std::uint64_t number{};
+    Chip8::framebuffer_t rows{};
+};
+
+
+
+// Encodes and writes frames on a background thread.
+// push() never blocks, frames are dropped if the writer falls behind.
+class Recorder {
+private:
+    SpscQueue<Frame, 512> queue_{};
+    std::atomic<std::uint64_t> dropped_{ 0 };
+    std::atomic<bool> running_{ true };
+    std::thread thread_;
+
+    // Writer thread only
+    std::ofstream file_;
+    std::uint16_t keyframe_interval_;
+    std::vector<Byte> buffer_;
+    std::vector<Byte> payload_;
+    std::uint64_t written_{ 0 };
+    std::uint64_t count_{ 0 };
+    std::uint64_t last_number_{ 0 };
+    Packed previous_{};
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> keyframes_;
+
+public:
+    // Default is a keyframe every 10 seconds of 60 Hz frames.
+    // Throws std::runtime_error if the file can't be created.
+    explicit Recorder(const std::string& path, std::uint16_t keyframe_interval = 600);
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // Calls finish()
+    ~Recorder();
+
+    // Returns false if the frame was dropped
+    bool push(const Chip8::framebuffer_t& fb, std::uint64_t number) noexcept;
+
+    // Write out pending frames and the index. Further pushes are dropped.
+    void finish();
+
+    std::uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    void write_loop();
+    void encode(const Frame& frame);
+    void flush();
+};
+
+
+
+// Decodes a stream read into memory
+class Reader {
+private:
+    std::vector<Byte> data_;
+    std::uint16_t keyframe_interval_{};
+    std::uint64_t count_{ 0 };
+    // (frame ordinal, offset) per keyframe
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> keyframes_;
+    // End of the frame records
+    size_t end_{ 0 };
+
+    size_t pos_{ 0 };
+    std::uint64_t ordinal_{ 0 };
+    Frame current_{};
+    Packed packed_{};
+
+public:
+    // Throws std::runtime_error on a missing file or bad header
+    explicit Reader(const std::string& path);
+
+    // Number of frames in the stream
+    std::uint64_t size() const noexcept { return count_; }
+    std::uint16_t keyframe_interval() const noexcept { return keyframe_interval_; }
+
+    // Make next() return the frame with this ordinal,
+    // decoding forward from the nearest keyframe
+    void seek(std::uint64_t ordinal);
+
+    // Nullopt at the end of the stream.
+    // Throws std::runtime_error on a malformed frame.
+    std::optional<Frame> next();
+
+private:
+    bool read_index();
+    void scan();
+};
+
+
+} // namespace framestream
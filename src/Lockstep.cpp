@@ -0,0 +1,104 @@
+#include "Lockstep.hpp"
+#include "Debug.hpp"
+#include <fmt/format.h>
+#include <iterator>
+
+
+std::uint16_t lockstep::keys_at(std::uint64_t input_seed, std::uint64_t frame) noexcept {
+    // splitmix64 of the 8 frame period
+    std::uint64_t z{ input_seed + (frame / 8 + 1) * 0x9E3779B97F4A7C15ull };
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+
+    // None half of the time
+    if (z & 0x10) { return 0; }
+    return static_cast<std::uint16_t>(1u << (z & 0xF));
+}
+
+
+
+namespace {
+
+void print_state(std::back_insert_iterator<std::string> out, std::string_view who, const Snapshot& s) {
+    fmt::format_to(
+        out, "  {:10} PC={:04X} I={:04X} SP={} DT={:02X} ST={:02X} V[{:02X}]\n",
+        who, s.pc, s.I, s.sp, s.delay_timer, s.sound_timer, fmt::join(s.V, ",")
+    );
+}
+
+
+template<typename T, size_t N>
+void diff_array(
+    std::back_insert_iterator<std::string> out, std::string_view name,
+    const std::array<T, N>& a, const std::array<T, N>& b, size_t limit = 8)
+{
+    size_t shown{ 0 };
+    size_t differing{ 0 };
+    for (size_t i{ 0 }; i < N; ++i) {
+        if (a[i] == b[i]) { continue; }
+        if (shown < limit) {
+            fmt::format_to(out, "  {}[{:#x}]: {:#x} vs {:#x}\n", name, i, a[i], b[i]);
+            ++shown;
+        }
+        ++differing;
+    }
+    if (differing > shown) {
+        fmt::format_to(out, "  ... {} more in {}\n", differing - shown, name);
+    }
+}
+
+
+template<typename T>
+void diff_field(std::back_insert_iterator<std::string> out, std::string_view name, T a, T b) {
+    if (a != b) {
+        fmt::format_to(out, "  {}: {:#x} vs {:#x}\n", name, a, b);
+    }
+}
+
+} // namespace
+
+
+
+std::string lockstep::describe(const Divergence& d, const Config& config) {
+    std::string text;
+    auto out = std::back_inserter(text);
+
+    const Short opcode = d.before.memory[d.before.pc % Chip8Base::memory_size] << 8 |
+        d.before.memory[(d.before.pc + 1u) % Chip8Base::memory_size];
+    const debug::OpcodeInfo info{ debug::disassemble(opcode) };
+
+    fmt::format_to(
+        out, "First divergence at instruction {} (frame {})\n",
+        d.instruction, d.instruction / config.cycles_per_frame
+    );
+    fmt::format_to(
+        out, "  {:04X}: [{:#06X}] {} {}  {}\n",
+        d.before.pc, opcode, info.name, info.pattern, info.desc
+    );
+    print_state(out, "before", d.before);
+    print_state(out, "reference", d.reference);
+    print_state(out, "candidate", d.candidate);
+
+    fmt::format_to(out, "Differences (reference vs candidate):\n");
+    const Snapshot& r = d.reference;
+    const Snapshot& c = d.candidate;
+    diff_field(out, "pc", r.pc, c.pc);
+    diff_field(out, "I", r.I, c.I);
+    diff_field(out, "opcode", r.opcode, c.opcode);
+    diff_field(out, "sp", r.sp, c.sp);
+    diff_field(out, "delay_timer", r.delay_timer, c.delay_timer);
+    diff_field(out, "sound_timer", r.sound_timer, c.sound_timer);
+    diff_field(out, "keys", r.keys, c.keys);
+    diff_field(out, "rng", r.rng, c.rng);
+    diff_field(out, "cycle_count", r.cycle_count, c.cycle_count);
+    diff_field(out, "draw_flag", r.draw_flag, c.draw_flag);
+    diff_field(out, "buzzing", r.buzzing, c.buzzing);
+    diff_field(out, "fault", r.fault, c.fault);
+    diff_array(out, "V", r.V, c.V);
+    diff_array(out, "stack", r.stack, c.stack);
+    diff_array(out, "memory", r.memory, c.memory);
+    diff_array(out, "frame", r.frame, c.frame);
+
+    return text;
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include "Chip8.hpp"
+#include "Codec.hpp"
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+
+
+// Differential testing of interpreter cores.
+//
+// A reference and a candidate core start from the same snapshot
+// (ROM and RNG seed included) and run the same instructions, keypad
+// input and timer ticks, all driven by the instruction count. Every
+// check_interval frames both fold their state into a rolling hash.
+// On a mismatch the run is replayed from the last matching checkpoint
+// down to the first instruction after which the states differ.
+// Differences that heal before a checkpoint go unnoticed, a shorter
+// interval catches more of them.
+namespace lockstep {
+
+// Anything that can stand in for Chip8
+template<typename C>
+concept Core = requires(C& c, const C& cc, Snapshot& out, const Snapshot& in, Byte key) {
+    c.load_state(in);
+    cc.save_state(out);
+    c.emulate_cycle();
+    c.update_timers();
+    c.key_press(key);
+    c.key_release(key);
+};
+
+
+struct Config {
+    size_t cycles_per_frame{ 10 };
+    std::uint64_t frames{ 3600 };
+    // Frames between state hash comparisons
+    std::uint64_t check_interval{ 60 };
+    // Drives the keypad input
+    std::uint64_t input_seed{ 1 };
+};
+
+
+struct Divergence {
+    // Index of the first instruction whose result differs
+    std::uint64_t instruction{};
+    // Common state right before it
+    Snapshot before{};
+    Snapshot reference{};
+    Snapshot candidate{};
+};
+
+
+struct Result {
+    std::uint64_t instructions{};
+    // Rolling hashes over all checkpoints
+    std::uint64_t reference_hash{};
+    std::uint64_t candidate_hash{};
+    std::optional<Divergence> divergence{};
+    // The states hashed differently at a checkpoint, but replaying up to
+    // it from the previous one found no difference: one of the cores
+    // doesn't behave the same given the same state
+    bool unreproducible{ false };
+};
+
+
+// Keypad state for a frame. Holds a random key or none
+// for 8 frames at a time, the same for every run with a seed.
+std::uint16_t keys_at(std::uint64_t input_seed, std::uint64_t frame) noexcept;
+
+// Field by field account of a divergence, with disassembly
+std::string describe(const Divergence& d, const Config& config);
+
+
+
+namespace detail {
+
+// Run instructions [from, to) of the schedule
+template<Core C>
+void run(C& core, const Config& config, std::uint64_t from, std::uint64_t to) {
+    const size_t cpf{ config.cycles_per_frame };
+    for (std::uint64_t i{ from }; i < to; ++i) {
+        if (i % cpf == 0) {
+            const std::uint16_t keys{ keys_at(config.input_seed, i / cpf) };
+            for (Byte id{ 0 }; id < 16; ++id) {
+                if (keys & (1u << id)) {
+                    core.key_press(id);
+                } else {
+                    core.key_release(id);
+                }
+            }
+        }
+        core.emulate_cycle();
+        if ((i + 1) % cpf == 0) {
+            core.update_timers();
+        }
+    }
+}
+
+
+template<Core C>
+Snapshot state_of(const C& core) {
+    Snapshot s;
+    core.save_state(s);
+    return s;
+}
+
+
+inline bool same(const Snapshot& a, const Snapshot& b) noexcept {
+    return std::memcmp(&a, &b, sizeof(Snapshot)) == 0;
+}
+
+} // namespace detail
+
+
+
+// Runs both cores from start according to config.
+// The cores' previous state doesn't matter.
+template<Core Reference, Core Candidate>
+Result compare(Reference& ref, Candidate& cand, const Snapshot& start, const Config& config) {
+    const std::uint64_t total{ config.frames * config.cycles_per_frame };
+    const std::uint64_t interval{
+        std::max<std::uint64_t>(config.check_interval, 1) * config.cycles_per_frame
+    };
+
+    Result result{};
+    result.reference_hash = codec::fnv1a({});
+    result.candidate_hash = result.reference_hash;
+
+    auto hash = [](const Snapshot& s, std::uint64_t seed) {
+        return codec::fnv1a({ reinterpret_cast<const Byte*>(&s), sizeof(s) }, seed);
+    };
+
+    ref.load_state(start);
+    cand.load_state(start);
+    Snapshot checkpoint{ start };
+
+    for (std::uint64_t at{ 0 }; at < total; ) {
+        const std::uint64_t n{ std::min(interval, total - at) };
+        detail::run(ref, config, at, at + n);
+        detail::run(cand, config, at, at + n);
+
+        const Snapshot ref_state{ detail::state_of(ref) };
+        result.reference_hash = hash(ref_state, result.reference_hash);
+        result.candidate_hash = hash(detail::state_of(cand), result.candidate_hash);
+
+        if (result.reference_hash == result.candidate_hash) {
+            checkpoint = ref_state;
+            at += n;
+            result.instructions = at;
+            continue;
+        }
+
+        // Replay from the checkpoint one instruction at a time. Bisecting
+        // would be shorter but can miss the first difference, which may
+        // heal before a later one (VF overwritten by the next ALU op).
+        ref.load_state(checkpoint);
+        cand.load_state(checkpoint);
+        Divergence d{};
+        d.before = checkpoint;
+        for (std::uint64_t i{ at }; i < at + n; ++i) {
+            detail::run(ref, config, i, i + 1);
+            detail::run(cand, config, i, i + 1);
+            d.reference = detail::state_of(ref);
+            d.candidate = detail::state_of(cand);
+            if (!detail::same(d.reference, d.candidate)) {
+                d.instruction = i;
+                result.instructions = i + 1;
+                result.divergence = d;
+                return result;
+            }
+            d.before = d.reference;
+        }
+
+        result.instructions = at + n;
+        result.unreproducible = true;
+        return result;
+    }
+
+    return result;
+}
+
+
+} // namespace lockstep
@@ -0,0 +1,273 @@
+#include "Metrics.hpp"
+#include <SFML/Network.hpp>
+#include <fmt/format.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+
+metrics::Histogram::Histogram(const std::vector<double>& bounds) {
+    if (bounds.size() > max_buckets || !std::is_sorted(bounds.begin(), bounds.end())) {
+        throw std::invalid_argument{ "Histogram bounds must be ascending, at most 16" };
+    }
+    std::copy(bounds.begin(), bounds.end(), bounds_.begin());
+    size_ = bounds.size();
+}
+
+
+metrics::Histogram::Summary metrics::Histogram::summary() const {
+    Summary s{};
+    s.bounds.assign(bounds_.begin(), bounds_.begin() + size_);
+    s.counts.reserve(size_ + 1);
+    for (size_t i{ 0 }; i <= size_; ++i) {
+        s.count += counts_[i].load(std::memory_order_relaxed);
+        s.counts.push_back(s.count);
+    }
+    s.sum = sum_.load(std::memory_order_relaxed);
+    return s;
+}
+
+
+std::vector<double> metrics::time_buckets() {
+    return { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+        0.0167, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0 };
+}
+
+
+
+
+metrics::Counter& metrics::Registry::counter(std::string name, std::string help) {
+    std::lock_guard lock{ mutex_ };
+    Counter& c = counters_.emplace_back();
+    add_entry(std::move(name), std::move(help), Kind::counter, &c);
+    return c;
+}
+
+
+metrics::Gauge& metrics::Registry::gauge(std::string name, std::string help) {
+    std::lock_guard lock{ mutex_ };
+    Gauge& g = gauges_.emplace_back();
+    add_entry(std::move(name), std::move(help), Kind::gauge, &g);
+    return g;
+}
+
+
+metrics::Histogram& metrics::Registry::histogram(
+    std::string name, std::string help, const std::vector<double>& bounds
+) {
+    std::lock_guard lock{ mutex_ };
+    Histogram& h = histograms_.emplace_back(bounds);
+    add_entry(std::move(name), std::move(help), Kind::histogram, &h);
+    return h;
+}
+
+
+void metrics::Registry::add_entry(
+    std::string name, std::string help, Kind kind, const void* metric
+) {
+    const bool taken = std::any_of(entries_.begin(), entries_.end(),
+        [&](const Entry& e) { return e.name == name; });
+    if (taken) {
+        throw std::invalid_argument{ "Duplicate metric: " + name };
+    }
+    entries_.push_back({ std::move(name), std::move(help), kind, metric });
+}
+
+
+std::string metrics::Registry::prometheus() const {
+    std::lock_guard lock{ mutex_ };
+
+    std::string out;
+    auto it = std::back_inserter(out);
+
+    for (const Entry& e : entries_) {
+        switch (e.kind) {
+            case Kind::counter:
+                fmt::format_to(it, "# HELP {0} {1}\n# TYPE {0} counter\n{0} {2}\n",
+                    e.name, e.help, static_cast<const Counter*>(e.metric)->value());
+                break;
+
+            case Kind::gauge:
+                fmt::format_to(it, "# HELP {0} {1}\n# TYPE {0} gauge\n{0} {2}\n",
+                    e.name, e.help, static_cast<const Gauge*>(e.metric)->value());
+                break;
+
+            case Kind::histogram: {
+                const auto s = static_cast<const Histogram*>(e.metric)->summary();
+                fmt::format_to(it, "# HELP {0} {1}\n# TYPE {0} histogram\n", e.name, e.help);
+                for (size_t i{ 0 }; i < s.bounds.size(); ++i) {
+                    fmt::format_to(it, "{}_bucket{{le=\"{}\"}} {}\n",
+                        e.name, s.bounds[i], s.counts[i]);
+                }
+                fmt::format_to(it, "{0}_bucket{{le=\"+Inf\"}} {1}\n{0}_sum {2}\n{0}_count {1}\n",
+                    e.name, s.count, s.sum);
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+
+
+
+metrics::Frontend::Frontend(Registry& r) :
+    instructions{ r.counter("chip8_instructions_total", "Instructions executed") },
+    instructions_per_second{ r.gauge("chip8_instructions_per_second",
+        "Instructions executed over the last second") },
+    frames{ r.counter("chip8_frames_total", "Frames emulated") },
+    frames_presented{ r.counter("chip8_frames_presented_total", "Frames presented to the window") },
+    frames_dropped{ r.counter("chip8_frames_dropped_total", "Frames that missed their deadline") },
+    sprite_draws{ r.counter("chip8_sprite_draws_total", "DXYN instructions executed") },
+    frame_time{ r.histogram("chip8_frame_seconds",
+        "Host time spent on a frame, excluding the wait for the next one", time_buckets()) },
+    update_time{ r.histogram("chip8_canvas_update_seconds",
+        "Time in Canvas::update", time_buckets()) },
+    redraw_time{ r.histogram("chip8_canvas_redraw_seconds",
+        "Time in Canvas::redraw", time_buckets()) },
+    input_latency{ r.histogram("chip8_input_to_present_seconds",
+        "Time from a key event to the next presented frame", time_buckets()) }
+{}
+
+
+
+
+metrics::Exporter::~Exporter() {
+    stop();
+}
+
+
+void metrics::Exporter::start(std::chrono::milliseconds period) {
+    thread_ = std::thread{ [this, period] {
+        std::unique_lock lock{ mutex_ };
+        while (!stop_) {
+            lock.unlock();
+            poll();
+            lock.lock();
+            stop_cv_.wait_for(lock, period, [this] { return stop_; });
+        }
+    } };
+}
+
+
+void metrics::Exporter::stop() {
+    {
+        std::lock_guard lock{ mutex_ };
+        stop_ = true;
+    }
+    stop_cv_.notify_all();
+    if (thread_.joinable()) { thread_.join(); }
+}
+
+
+
+
+metrics::FileExporter::FileExporter(
+    const Registry& registry, std::string path, std::chrono::milliseconds period
+) :
+    Exporter{ registry },
+    path_{ std::move(path) }
+{
+    start(period);
+}
+
+
+metrics::FileExporter::~FileExporter() {
+    stop();
+    // Final values
+    poll();
+}
+
+
+void metrics::FileExporter::poll() {
+    const std::string tmp{ path_ + ".tmp" };
+    {
+        std::ofstream fs{ tmp, std::ios_base::trunc };
+        fs << registry_.prometheus();
+        if (fs.fail()) { return; }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path_, ec);
+}
+
+
+
+
+struct metrics::HttpExporter::Server {
+    sf::TcpListener listener;
+    sf::SocketSelector selector;
+};
+
+
+metrics::HttpExporter::HttpExporter(const Registry& registry, unsigned short port) :
+    Exporter{ registry },
+    server_{ std::make_unique<Server>() }
+{
+    if (server_->listener.listen(port, sf::IpAddress::LocalHost) != sf::Socket::Done) {
+        throw std::runtime_error{ fmt::format("Unable to listen on port {}", port) };
+    }
+    server_->selector.add(server_->listener);
+    // poll() blocks on the selector itself
+    start(std::chrono::milliseconds{ 0 });
+}
+
+
+metrics::HttpExporter::~HttpExporter() {
+    stop();
+}
+
+
+void metrics::HttpExporter::poll() {
+    // Short timeout keeps stop() responsive
+    if (!server_->selector.wait(sf::milliseconds(100))) { return; }
+
+    sf::TcpSocket client;
+    if (server_->listener.accept(client) != sf::Socket::Done) { return; }
+
+    // Whatever the request, wait briefly for it and answer with the metrics
+    sf::SocketSelector request;
+    request.add(client);
+    if (request.wait(sf::milliseconds(500))) {
+        char buffer[1024];
+        size_t received{ 0 };
+        client.receive(buffer, sizeof(buffer), received);
+    }
+
+    const std::string body{ registry_.prometheus() };
+    const std::string response{ fmt::format(
+        "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: {}\r\n"
+        "Connection: close\r\n"
+        "\r\n{}",
+        body.size(), body
+    ) };
+    client.send(response.data(), response.size());
+    client.disconnect();
+}
+
+
+
+
+std::unique_ptr<metrics::Exporter> metrics::make_exporter(
+    const Registry& registry, std::string_view spec
+) {
+    if (spec.starts_with("http:")) {
+        unsigned long port{ 0 };
+        try {
+            port = std::stoul(std::string{ spec.substr(5) });
+        } catch (const std::logic_error&) {}
+        if (port == 0 || port > 0xFFFF) {
+            throw std::invalid_argument{ "Invalid metrics port: " + std::string{ spec.substr(5) } };
+        }
+        return std::make_unique<HttpExporter>(registry, static_cast<unsigned short>(port));
+    }
+    if (spec.starts_with("file:")) {
+        return std::make_unique<FileExporter>(
+            registry, std::string{ spec.substr(5) }, std::chrono::seconds{ 1 }
+        );
+    }
+    throw std::invalid_argument{ "Unknown metrics exporter: " + std::string{ spec } };
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+// Always-on instrumentation.
+//
+// Metrics are lock-free relaxed atomics, cheap enough to update
+// from the emulation loop. A Registry owns them by name and formats
+// them as Prometheus text, which an Exporter serves on a local port
+// or writes to a file periodically.
+namespace metrics {
+
+class Counter {
+private:
+    std::atomic<std::uint64_t> value_{ 0 };
+public:
+    void add(std::uint64_t n = 1) noexcept { value_.fetch_add(n, std::memory_order_relaxed); }
+    std::uint64_t value() const noexcept { return value_.load(std::memory_order_relaxed); }
+};
+
+
+class Gauge {
+private:
+    std::atomic<double> value_{ 0.0 };
+public:
+    void set(double v) noexcept { value_.store(v, std::memory_order_relaxed); }
+    double value() const noexcept { return value_.load(std::memory_order_relaxed); }
+};
+
+
+// Fixed buckets, counts are not cumulative until read
+class Histogram {
+public:
+    static constexpr size_t max_buckets{ 16 };
+
+    struct Summary {
+        std::vector<double> bounds;
+        // Cumulative count per bound, the last one is +Inf
+        std::vector<std::uint64_t> counts;
+        double sum{};
+        std::uint64_t count{};
+    };
+
+private:
+    std::array<double, max_buckets> bounds_{};
+    size_t size_{ 0 };
+    std::array<std::atomic<std::uint64_t>, max_buckets + 1> counts_{};
+    std::atomic<double> sum_{ 0.0 };
+
+public:
+    // Ascending upper bounds, at most max_buckets of them.
+    // Throws std::invalid_argument otherwise.
+    explicit Histogram(const std::vector<double>& bounds);
+
+    void observe(double v) noexcept {
+        size_t i{ 0 };
+        while (i < size_ && v > bounds_[i]) { ++i; }
+        counts_[i].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    void observe(std::chrono::nanoseconds d) noexcept {
+        observe(std::chrono::duration<double>(d).count());
+    }
+
+    Summary summary() const;
+};
+
+
+// Upper bounds in seconds, 100us to 1s
+std::vector<double> time_buckets();
+
+
+
+// Named metrics. Registration locks, updating the returned
+// references doesn't. References stay valid for its lifetime.
+class Registry {
+private:
+    enum class Kind { counter, gauge, histogram };
+
+    struct Entry {
+        std::string name;
+        std::string help;
+        Kind kind;
+        const void* metric;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> entries_;
+    std::deque<Counter> counters_;
+    std::deque<Gauge> gauges_;
+    std::deque<Histogram> histograms_;
+
+public:
+    // Throws std::invalid_argument on a duplicate name
+    Counter& counter(std::string name, std::string help);
+    Gauge& gauge(std::string name, std::string help);
+    Histogram& histogram(std::string name, std::string help, const std::vector<double>& bounds);
+
+    // Text exposition format 0.0.4
+    std::string prometheus() const;
+
+private:
+    void add_entry(std::string name, std::string help, Kind kind, const void* metric);
+};
+
+
+
+// Metrics of the interactive frontend
+struct Frontend {
+    Counter& instructions;
+    Gauge& instructions_per_second;
+    Counter& frames;
+    Counter& frames_presented;
+    Counter& frames_dropped;
+    Counter& sprite_draws;
+    Histogram& frame_time;
+    Histogram& update_time;
+    Histogram& redraw_time;
+    Histogram& input_latency;
+
+    explicit Frontend(Registry& registry);
+};
+
+
+
+class Exporter {
+protected:
+    const Registry& registry_;
+
+private:
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    bool stop_{ false };
+
+public:
+    explicit Exporter(const Registry& registry) noexcept : registry_{ registry } {}
+
+    Exporter(const Exporter&) = delete;
+    Exporter& operator=(const Exporter&) = delete;
+
+    // Derived classes must stop() in their destructor
+    virtual ~Exporter();
+
+protected:
+    // Calls poll() every period until stopped
+    void start(std::chrono::milliseconds period);
+    void stop();
+
+    virtual void poll() = 0;
+};
+
+
+// Rewrites a file with the current metrics every period,
+// replacing it atomically so readers never see a partial one.
+class FileExporter final : public Exporter {
+private:
+    std::string path_;
+
+public:
+    FileExporter(const Registry& registry, std::string path, std::chrono::milliseconds period);
+    ~FileExporter() override;
+
+protected:
+    void poll() override;
+};
+
+
+// Serves the metrics over HTTP on 127.0.0.1:port, any path.
+class HttpExporter final : public Exporter {
+private:
+    struct Server;
+    std::unique_ptr<Server> server_;
+
+public:
+    // Throws std::runtime_error if the port can't be bound
+    HttpExporter(const Registry& registry, unsigned short port);
+    ~HttpExporter() override;
+
+protected:
+    void poll() override;
+};
+
+
+// Creates an exporter from a spec: "http:<port>" or "file:<path>".
+// Throws std::invalid_argument on an unknown spec.
+std::unique_ptr<Exporter> make_exporter(const Registry& registry, std::string_view spec);
+
+
+} // namespace metrics
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+
+// Small text helpers shared by the config, probe and debugger parsers.
+namespace text {
+
+// Without leading and trailing blanks
+inline std::string_view trim(std::string_view sv) noexcept {
+    const auto first = sv.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) { return {}; }
+    return sv.substr(first, sv.find_last_not_of(" \t\r") - first + 1);
+}
+
+// Accepts decimal, 0x-prefixed hex and 0-prefixed octal, blanks around it.
+// Throws std::invalid_argument or std::out_of_range otherwise.
+inline std::uint64_t parse_uint(std::string_view sv) {
+    const std::string str{ trim(sv) };
+    size_t used{ 0 };
+    const auto value = std::stoull(str, &used, 0);
+    if (used != str.size()) { throw std::invalid_argument{ str }; }
+    return value;
+}
+
+} // namespace text
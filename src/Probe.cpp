@@ -0,0 +1,27 @@
+#include "Probe.hpp"
+#include "Parse.hpp"
+#include <fmt/format.h>
+#include <stdexcept>
+#include <string>
+
+
+
+Probe Probe::parse(std::string_view spec) {
+    spec = text::trim(spec);
+
+    try {
+        if (spec.starts_with("mem:")) {
+            const auto addr = text::parse_uint(spec.substr(4));
+            if (addr < 0x1000) {
+                return { Source::memory, static_cast<Short>(addr) };
+            }
+        } else if (spec == "I") {
+            return { Source::index, 0 };
+        } else if (spec.size() == 2 && (spec[0] == 'V' || spec[0] == 'v')) {
+            const auto x = std::stoul(std::string{ spec.substr(1) }, nullptr, 16);
+            return { Source::reg, static_cast<Short>(x) };
+        }
+    } catch (const std::logic_error&) {}
+
+    throw std::invalid_argument{ fmt::format("Invalid probe: '{}'", spec) };
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "Chip8.hpp"
+#include <cstdint>
+#include <string_view>
+
+
+// Reads one byte of machine state: "mem:<addr>", "V<x>" or "I".
+// Used to derive rewards and episode ends from RAM or registers.
+class Probe {
+public:
+    enum class Source { memory, reg, index };
+
+private:
+    Source source_{ Source::memory };
+    Short where_{ 0 };
+
+public:
+    Probe(Source source, Short where) noexcept :
+        source_{ source }, where_{ where }
+    {}
+
+    // Throws std::invalid_argument on a malformed spec
+    static Probe parse(std::string_view spec);
+
+    std::uint16_t read(const Chip8& c8) const noexcept {
+        switch (source_) {
+            case Source::memory: return c8.peek(where_);
+            case Source::reg:    return c8.get_registers()[where_ & 0xF];
+            case Source::index:  return c8.get_index();
+        }
+        return 0;
+    }
+};
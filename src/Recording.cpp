@@ -0,0 +1,288 @@
+#include "Recording.hpp"
+#include "Codec.hpp"
+#include "Snapshot.hpp"
+#include "Timing.hpp"
+#include <cstring>
+#include <stdexcept>
+
+
+namespace {
+
+constexpr char magic[4]{ 'C', '8', 'R', 'C' };
+
+constexpr Byte tag_key{ 0x00 };
+constexpr Byte tag_key_press_bit{ 0x10 };
+constexpr Byte tag_hash{ 0x40 };
+constexpr Byte tag_end{ 0x7F };
+
+constexpr size_t flush_threshold{ 4096 };
+
+
+template<typename UInt>
+void put_le(std::vector<Byte>& out, UInt v) {
+    for (size_t i{ 0 }; i < sizeof(UInt); ++i) {
+        out.push_back(static_cast<Byte>(v >> (8 * i)));
+    }
+}
+
+template<typename UInt>
+UInt get_le(std::istream& is) {
+    UInt v{ 0 };
+    for (size_t i{ 0 }; i < sizeof(UInt); ++i) {
+        const int c{ is.get() };
+        if (c == std::char_traits<char>::eof()) {
+            throw std::runtime_error{ "Truncated recording" };
+        }
+        v |= static_cast<UInt>(UInt(c) << (8 * i));
+    }
+    return v;
+}
+
+} // namespace
+
+
+
+
+std::uint64_t recording::rom_hash(std::span<const Byte> rom) noexcept {
+    return codec::fnv1a(rom);
+}
+
+
+
+
+
+recording::Recorder::Recorder(const std::string& path, const Header& header) :
+    file_{ path, std::ios_base::binary | std::ios_base::trunc }
+{
+    if (file_.fail()) {
+        throw std::runtime_error{ "Unable to create recording: " + path };
+    }
+    buffer_.reserve(2 * flush_threshold);
+
+    buffer_.insert(buffer_.end(), std::begin(magic), std::end(magic));
+    put_le(buffer_, format_version);
+    put_le(buffer_, header.cycles_per_frame);
+    put_le(buffer_, header.rom_hash);
+    put_le(buffer_, header.seed);
+    flush();
+}
+
+
+recording::Recorder::~Recorder() {
+    if (!finished_) {
+        // Still usable: the reader treats EOF as the end
+        flush();
+    }
+}
+
+
+void recording::Recorder::key_event(std::uint64_t cycle, Byte key, bool pressed) {
+    put_record(
+        static_cast<Byte>(tag_key | (pressed ? tag_key_press_bit : 0) | (key & 0x0F)),
+        cycle
+    );
+}
+
+
+void recording::Recorder::state_hash(std::uint64_t cycle, std::uint64_t hash) {
+    put_record(tag_hash, cycle);
+    put_le(buffer_, hash);
+}
+
+
+void recording::Recorder::finish(std::uint64_t cycle) {
+    if (finished_) { return; }
+    put_record(tag_end, cycle);
+    flush();
+    finished_ = true;
+}
+
+
+void recording::Recorder::put_record(Byte tag, std::uint64_t cycle) {
+    if (buffer_.size() >= flush_threshold) { flush(); }
+
+    buffer_.push_back(tag);
+    codec::put_varint(buffer_, cycle - last_cycle_);
+    last_cycle_ = cycle;
+}
+
+
+void recording::Recorder::flush() {
+    file_.write(
+        reinterpret_cast<const char*>(buffer_.data()),
+        static_cast<std::streamsize>(buffer_.size())
+    );
+    file_.flush();
+    buffer_.clear();
+}
+
+
+
+
+
+recording::Reader::Reader(const std::string& path) :
+    file_{ path, std::ios_base::binary }
+{
+    if (file_.fail()) {
+        throw std::runtime_error{ "Unable to open recording: " + path };
+    }
+
+    char m[4]{};
+    file_.read(m, 4);
+    if (file_.fail() || std::memcmp(m, magic, 4) != 0) {
+        throw std::runtime_error{ "Not a recording: " + path };
+    }
+
+    const auto version = get_le<std::uint16_t>(file_);
+    if (version != format_version) {
+        throw std::runtime_error{
+            fmt::format("Unsupported recording version: {}", version)
+        };
+    }
+    header_.cycles_per_frame = get_le<std::uint16_t>(file_);
+    header_.rom_hash = get_le<std::uint64_t>(file_);
+    header_.seed = get_le<std::uint64_t>(file_);
+}
+
+
+std::optional<recording::Record> recording::Reader::next() {
+
+    if (done_) { return {}; }
+
+    const int c{ file_.get() };
+    if (c == std::char_traits<char>::eof()) {
+        done_ = true;
+        return {};
+    }
+    const auto tag = static_cast<Byte>(c);
+
+    Record rec{};
+    cycle_ += get_varint();
+    rec.cycle = cycle_;
+
+    if (tag < 0x20) {
+        rec.kind = (tag & tag_key_press_bit) ?
+            Record::Kind::key_press : Record::Kind::key_release;
+        rec.key = tag & 0x0F;
+    } else if (tag == tag_hash) {
+        rec.kind = Record::Kind::state_hash;
+        rec.hash = get_le<std::uint64_t>(file_);
+    } else if (tag == tag_end) {
+        rec.kind = Record::Kind::end;
+        done_ = true;
+    } else {
+        throw std::runtime_error{ fmt::format("Unknown record tag: {:#04x}", tag) };
+    }
+    return rec;
+}
+
+
+std::uint64_t recording::Reader::get_varint() {
+    std::uint64_t value{ 0 };
+    for (unsigned shift{ 0 }; shift < 64; shift += 7) {
+        const int c{ file_.get() };
+        if (c == std::char_traits<char>::eof()) {
+            throw std::runtime_error{ "Truncated recording" };
+        }
+        value |= std::uint64_t(c & 0x7F) << shift;
+        if (!(c & 0x80)) { return value; }
+    }
+    throw std::runtime_error{ "Malformed varint in recording" };
+}
+
+
+
+
+
+recording::ReplayResult recording::replay(
+    const std::string& path,
+    std::span<const Byte> rom
+) {
+    Reader reader{ path };
+    const Header& header = reader.header();
+
+    if (header.rom_hash != rom_hash(rom)) {
+        throw std::runtime_error{ "Recording was made with a different ROM" };
+    }
+
+    ReplayResult result{};
+    const auto start = std::chrono::steady_clock::now();
+
+    Chip8 chip8{};
+    chip8.seed(header.seed);
+    chip8.load_program(rom);
+
+    std::optional<timing::Clock> clock{};
+    if (header.cycles_per_frame == 0) {
+        clock.emplace();
+    }
+
+    auto rec = reader.next();
+
+    while (rec) {
+        bool frame_done{ false };
+        for (unsigned cycle{ 1 }; !frame_done; ++cycle) {
+            const auto now = chip8.get_cycle_count();
+
+            while (rec && rec->cycle == now &&
+                (rec->kind == Record::Kind::key_press ||
+                 rec->kind == Record::Kind::key_release))
+            {
+                if (rec->kind == Record::Kind::key_press) {
+                    chip8.key_press(rec->key);
+                } else {
+                    chip8.key_release(rec->key);
+                }
+                rec = reader.next();
+            }
+
+            if (rec && rec->kind == Record::Kind::end && rec->cycle == now) {
+                rec.reset();
+                break;
+            }
+
+            if (clock) {
+                frame_done = clock->step(chip8);
+            } else {
+                chip8.emulate_cycle();
+                frame_done = cycle == header.cycles_per_frame;
+            }
+        }
+        if (!rec) { break; }
+
+        if (!clock) { chip8.update_timers(); }
+        ++result.frames;
+
+        while (rec && rec->kind == Record::Kind::state_hash &&
+            rec->cycle == chip8.get_cycle_count())
+        {
+            ++result.hashes_checked;
+            if (!result.desync_cycle &&
+                snapshot::hash(chip8.snapshot()) != rec->hash)
+            {
+                result.desync_cycle = rec->cycle;
+            }
+            rec = reader.next();
+        }
+
+        chip8.reset_draw_flag();
+
+        if (rec && rec->cycle < chip8.get_cycle_count()) {
+            throw std::runtime_error{ "Recording records are out of order" };
+        }
+        // A faulted core no longer counts cycles, later records would never come due
+        if (rec && rec->cycle > chip8.get_cycle_count() &&
+            chip8.get_fault() != Chip8::Fault::none)
+        {
+            throw std::runtime_error{ fmt::format(
+                "Recording continues past a halt on {} at cycle {}",
+                to_string(chip8.get_fault()), chip8.get_cycle_count()
+            ) };
+        }
+    }
+
+    result.cycles = chip8.get_cycle_count();
+    result.final_hash = snapshot::hash(chip8.snapshot());
+    result.elapsed = std::chrono::steady_clock::now() - start;
+    return result;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "Chip8.hpp"
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+
+// Input recording format (all integers little-endian):
+//
+//   Header: "C8RC", u16 version, u16 cycles_per_frame,
+//           u64 ROM hash (FNV-1a), u64 RNG seed
+//   cycles_per_frame of 0 stands for VIP timing (see Timing.hpp)
+//
+//   Records: tag byte followed by a varint cycle delta
+//   relative to the previous record:
+//     0x00-0x1F  key event, bit 4 set on press, bits 0-3 key id
+//     0x40       state hash, followed by u64 hash
+//     0x7F       end of recording
+//
+// Key events are stamped with the cycle they precede.
+// State hashes are taken after the timers tick at the end of a frame,
+// or at the instruction that crossed vblank with VIP timing.
+namespace recording {
+
+// Version 2: state hashes cover the packed state layout
+constexpr std::uint16_t format_version{ 2 };
+
+
+struct Header {
+    // Instructions per frame, 0 for VIP timing
+    std::uint16_t cycles_per_frame{};
+    std::uint64_t rom_hash{};
+    std::uint64_t seed{};
+};
+
+
+struct Record {
+    enum class Kind : Byte { key_release, key_press, state_hash, end };
+
+    Kind kind{};
+    Byte key{};
+    std::uint64_t cycle{};
+    std::uint64_t hash{};
+};
+
+
+std::uint64_t rom_hash(std::span<const Byte> rom) noexcept;
+
+
+class Recorder {
+private:
+    std::ofstream file_;
+    std::vector<Byte> buffer_;
+    std::uint64_t last_cycle_{ 0 };
+    bool finished_{ false };
+
+public:
+    // Throws std::runtime_error if the file can't be created
+    Recorder(const std::string& path, const Header& header);
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    ~Recorder();
+
+    void key_event(std::uint64_t cycle, Byte key, bool pressed);
+    void state_hash(std::uint64_t cycle, std::uint64_t hash);
+
+    // Write the end record and flush.
+    void finish(std::uint64_t cycle);
+
+private:
+    void put_record(Byte tag, std::uint64_t cycle);
+    void flush();
+};
+
+
+class Reader {
+private:
+    std::ifstream file_;
+    Header header_{};
+    std::uint64_t cycle_{ 0 };
+    bool done_{ false };
+
+public:
+    // Throws std::runtime_error on a missing file or bad header
+    explicit Reader(const std::string& path);
+
+    const Header& header() const noexcept { return header_; }
+
+    // Next record, nullopt after the end record or at EOF.
+    // Throws std::runtime_error on a malformed record.
+    std::optional<Record> next();
+
+private:
+    std::uint64_t get_varint();
+};
+
+
+
+struct ReplayResult {
+    std::uint64_t cycles{};
+    std::uint64_t frames{};
+    std::uint64_t hashes_checked{};
+    std::uint64_t final_hash{};
+    // Cycle of the first mismatching state hash
+    std::optional<std::uint64_t> desync_cycle{};
+    std::chrono::steady_clock::duration elapsed{};
+};
+
+
+// Replay a recording headlessly and as fast as possible.
+// Throws std::runtime_error if the ROM doesn't match the recording
+// or it goes on after the interpreter halted on a fault.
+ReplayResult replay(const std::string& path, std::span<const Byte> rom);
+
+
+} // namespace recording
@@ -0,0 +1,122 @@
+#include "Rewind.hpp"
+#include <utility>
+
+
+namespace {
+
+std::span<const Byte> as_bytes(const Snapshot& s) noexcept {
+    return { reinterpret_cast<const Byte*>(&s), sizeof(Snapshot) };
+}
+
+std::span<Byte> as_writable_bytes(Snapshot& s) noexcept {
+    return { reinterpret_cast<Byte*>(&s), sizeof(Snapshot) };
+}
+
+} // namespace
+
+
+
+
+void RewindBuffer::push(const Snapshot& s) {
+
+    if (groups_.empty() || groups_.back().offsets.size() >= keyframe_interval_) {
+        if (!spare_.empty()) {
+            groups_.push_back(std::move(spare_.back()));
+            spare_.pop_back();
+        } else {
+            groups_.emplace_back();
+            groups_.back().offsets.reserve(keyframe_interval_);
+        }
+        Group& group = groups_.back();
+        group.keyframe = s;
+        group.deltas.clear();
+        group.offsets.clear();
+        group.offsets.push_back(0);
+    } else {
+        Group& group = groups_.back();
+        group.offsets.push_back(static_cast<std::uint32_t>(group.deltas.size()));
+        codec::encode_xor(as_bytes(group.keyframe), as_bytes(s), group.deltas);
+    }
+    ++size_;
+
+    // Evict whole groups, keeping at least capacity_ entries
+    while (size_ - groups_.front().offsets.size() >= capacity_) {
+        size_ -= groups_.front().offsets.size();
+        spare_.push_back(std::move(groups_.front()));
+        groups_.pop_front();
+    }
+}
+
+
+
+bool RewindBuffer::restore(size_t frames_back, Snapshot& out) const noexcept {
+
+    if (frames_back >= size_) { return false; }
+
+    for (auto it = groups_.rbegin(); it != groups_.rend(); ++it) {
+        const size_t n{ it->offsets.size() };
+        if (frames_back >= n) {
+            frames_back -= n;
+            continue;
+        }
+
+        const size_t idx{ n - 1 - frames_back };
+        const size_t begin{ it->offsets[idx] };
+        const size_t end{ idx + 1 < n ? it->offsets[idx + 1] : it->deltas.size() };
+
+        out = it->keyframe;
+        return codec::apply_xor(
+            { it->deltas.data() + begin, end - begin },
+            as_writable_bytes(out)
+        );
+    }
+    return false;
+}
+
+
+
+void RewindBuffer::truncate(size_t frames_back) {
+
+    while (frames_back && !groups_.empty()) {
+        Group& group = groups_.back();
+        const size_t n{ group.offsets.size() };
+
+        if (frames_back >= n) {
+            frames_back -= n;
+            size_ -= n;
+            spare_.push_back(std::move(group));
+            groups_.pop_back();
+        } else {
+            const size_t keep{ n - frames_back };
+            group.deltas.resize(group.offsets[keep]);
+            group.offsets.resize(keep);
+            size_ -= frames_back;
+            frames_back = 0;
+        }
+    }
+}
+
+
+
+void RewindBuffer::clear() {
+    while (!groups_.empty()) {
+        spare_.push_back(std::move(groups_.back()));
+        groups_.pop_back();
+    }
+    size_ = 0;
+}
+
+
+
+size_t RewindBuffer::memory_usage() const noexcept {
+    size_t total{ 0 };
+    for (const auto& group : groups_) {
+        total += sizeof(Group) + group.deltas.capacity() +
+            group.offsets.capacity() * sizeof(std::uint32_t);
+    }
+    for (const auto& group : spare_) {
+        total += sizeof(Group) + group.deltas.capacity() +
+            group.offsets.capacity() * sizeof(std::uint32_t);
+    }
+    return total;
+}
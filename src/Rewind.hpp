@@ -0,0 +1,60 @@
+#pragma once
+#include "Chip8.hpp"
+#include "Codec.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+
+// Ring of per-frame snapshots for rewinding.
+//
+// Every keyframe_interval-th snapshot is stored whole, the rest
+// as RLE-compressed XOR deltas against their keyframe, so any
+// entry restores with a copy and a single delta application.
+// The oldest keyframe group is dropped once capacity is exceeded.
+class RewindBuffer {
+private:
+    struct Group {
+        Snapshot keyframe;
+        std::vector<Byte> deltas;
+        // Start of each delta in deltas, first one is the keyframe itself
+        std::vector<std::uint32_t> offsets;
+    };
+
+    size_t capacity_;
+    size_t keyframe_interval_;
+    std::deque<Group> groups_;
+    size_t size_{ 0 };
+
+    // Recycled storage of evicted groups
+    std::vector<Group> spare_;
+
+public:
+    // Default holds 5 minutes of 60 Hz frames
+    explicit RewindBuffer(
+        size_t capacity = 5 * 60 * 60,
+        size_t keyframe_interval = 120
+    ) :
+        capacity_{ capacity ? capacity : 1 },
+        keyframe_interval_{ keyframe_interval ? keyframe_interval : 1 }
+    {}
+
+    void push(const Snapshot& s);
+
+    // Restore the snapshot pushed frames_back pushes ago (0 is the latest).
+    // Returns false if that far back is not available.
+    bool restore(size_t frames_back, Snapshot& out) const noexcept;
+
+    // Drop everything newer than frames_back,
+    // so that recording resumes from that point.
+    void truncate(size_t frames_back);
+
+    void clear();
+
+    size_t size() const noexcept { return size_; }
+    size_t capacity() const noexcept { return capacity_; }
+
+    // Approximate heap usage
+    size_t memory_usage() const noexcept;
+};
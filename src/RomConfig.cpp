@@ -0,0 +1,67 @@
+#include "RomConfig.hpp"
+#include "Parse.hpp"
+#include <fmt/format.h>
+#include <fstream>
+#include <stdexcept>
+
+
+
+
+RomConfig RomConfig::load_for(const std::string& rom_path) {
+    return load(rom_path + ".cfg");
+}
+
+
+RomConfig RomConfig::load(const std::string& path) {
+
+    RomConfig config{};
+    config.path_ = path;
+
+    std::ifstream fs{ path };
+    if (fs.fail()) { return config; }
+
+    std::string line;
+    for (size_t line_no{ 1 }; std::getline(fs, line); ++line_no) {
+        std::string_view sv{ line };
+        if (auto comment = sv.find('#'); comment != std::string_view::npos) {
+            sv = sv.substr(0, comment);
+        }
+        sv = text::trim(sv);
+        if (sv.empty()) { continue; }
+
+        const auto eq = sv.find('=');
+        if (eq == std::string_view::npos || text::trim(sv.substr(0, eq)).empty()) {
+            throw std::runtime_error{
+                fmt::format("{}:{}: expected 'key = value'", path, line_no)
+            };
+        }
+        config.values_.insert_or_assign(
+            std::string{ text::trim(sv.substr(0, eq)) },
+            std::string{ text::trim(sv.substr(eq + 1)) }
+        );
+    }
+    return config;
+}
+
+
+
+std::optional<std::string_view> RomConfig::get(std::string_view key) const {
+    if (auto it = values_.find(key); it != values_.end()) {
+        return it->second;
+    }
+    return {};
+}
+
+
+std::uint64_t RomConfig::get_uint(std::string_view key, std::uint64_t fallback) const {
+    auto value = get(key);
+    if (!value) { return fallback; }
+
+    try {
+        return text::parse_uint(*value);
+    } catch (const std::logic_error&) {}
+
+    throw std::runtime_error{
+        fmt::format("{}: '{}' is not a number: {}", path_, key, *value)
+    };
+}
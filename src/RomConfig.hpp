@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+
+
+// Per-ROM settings, read from a "<rom>.cfg" file next to the ROM.
+// One "key = value" pair per line, '#' starts a comment.
+class RomConfig {
+private:
+    std::map<std::string, std::string, std::less<>> values_;
+    std::string path_;
+
+public:
+    RomConfig() = default;
+
+    // Missing file yields an empty config.
+    // Throws std::runtime_error on a malformed line.
+    static RomConfig load_for(const std::string& rom_path);
+    static RomConfig load(const std::string& path);
+
+    std::optional<std::string_view> get(std::string_view key) const;
+
+    // Throws std::runtime_error if present but not a number.
+    // Accepts decimal, 0x-prefixed hex and 0-prefixed octal.
+    std::uint64_t get_uint(std::string_view key, std::uint64_t fallback) const;
+
+    const std::string& path() const noexcept { return path_; }
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+
+// Layout of the shared-memory framebuffer ring written by ShmDisplay.
+// Self-contained, so external consumers can include it on its own.
+//
+// The object starts with a Header followed by slot_count Slots.
+// Frame n (counting from 1) goes into slot n % slot_count, and
+// Header::sequence is bumped to n once it's complete. Slots are
+// seqlocked: a reader copies a slot and keeps the copy only if
+// the slot's sequence was the same before and after.
+namespace shm_ring {
+
+constexpr char magic[4]{ 'C', '8', 'F', 'B' };
+constexpr std::uint32_t format_version{ 1 };
+
+constexpr std::uint32_t width{ 64 };
+constexpr std::uint32_t height{ 32 };
+constexpr std::uint32_t slot_count{ 8 };
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+
+struct Header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t slot_count;
+    std::uint32_t slot_size;
+    // Last complete frame, 0 before the first one
+    std::atomic<std::uint64_t> sequence;
+};
+
+
+struct Slot {
+    // Frame held by the slot, 0 while it's being written
+    std::atomic<std::uint64_t> sequence;
+    // steady_clock time of the frame, in nanoseconds
+    std::uint64_t timestamp_ns;
+    // One word per row, leftmost pixel in the MSB
+    std::array<std::uint64_t, height> rows;
+};
+
+
+struct Frame {
+    std::uint64_t sequence{};
+    std::uint64_t timestamp_ns{};
+    std::array<std::uint64_t, height> rows{};
+};
+
+
+constexpr size_t size{ sizeof(Header) + slot_count * sizeof(Slot) };
+
+
+inline Slot* slots(Header* header) noexcept {
+    return reinterpret_cast<Slot*>(header + 1);
+}
+
+inline const Slot* slots(const Header* header) noexcept {
+    return reinterpret_cast<const Slot*>(header + 1);
+}
+
+
+// Copy the latest frame into out. Returns false if there's none yet,
+// or the writer lapped the reader, in which case it's worth retrying.
+inline bool read_latest(const Header* header, Frame& out) noexcept {
+    const std::uint64_t n{ header->sequence.load(std::memory_order_acquire) };
+    if (n == 0) { return false; }
+
+    const Slot& slot = slots(header)[n % slot_count];
+    if (slot.sequence.load(std::memory_order_acquire) != n) { return false; }
+
+    out.timestamp_ns = slot.timestamp_ns;
+    std::memcpy(out.rows.data(), slot.rows.data(), sizeof(out.rows));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != n) { return false; }
+
+    out.sequence = n;
+    return true;
+}
+
+} // namespace shm_ring
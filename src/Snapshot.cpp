@@ -0,0 +1,190 @@
+#include "Snapshot.hpp"
+#include "Codec.hpp"
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+
+
+namespace {
+
+constexpr char magic[4]{ 'C', '8', 'S', 'S' };
+constexpr size_t header_size{ 12 };
+constexpr size_t trailer_size{ 8 };
+
+
+class Writer {
+private:
+    std::vector<Byte>& out_;
+public:
+    explicit Writer(std::vector<Byte>& out) : out_{ out } {}
+
+    template<typename UInt>
+    void put(UInt v) {
+        for (size_t i{ 0 }; i < sizeof(UInt); ++i) {
+            out_.push_back(static_cast<Byte>(v >> (8 * i)));
+        }
+    }
+
+    template<typename UInt, size_t N>
+    void put(const std::array<UInt, N>& arr) {
+        for (UInt v : arr) { put(v); }
+    }
+};
+
+
+class Reader {
+private:
+    std::span<const Byte> in_;
+    size_t pos_{ 0 };
+public:
+    explicit Reader(std::span<const Byte> in) : in_{ in } {}
+
+    template<typename UInt>
+    UInt get() {
+        if (in_.size() - pos_ < sizeof(UInt)) {
+            throw std::runtime_error{ "Truncated save state" };
+        }
+        UInt v{ 0 };
+        for (size_t i{ 0 }; i < sizeof(UInt); ++i) {
+            v |= static_cast<UInt>(UInt{ in_[pos_++] } << (8 * i));
+        }
+        return v;
+    }
+
+    template<typename UInt, size_t N>
+    void get(std::array<UInt, N>& arr) {
+        for (UInt& v : arr) { v = get<UInt>(); }
+    }
+
+    size_t pos() const noexcept { return pos_; }
+};
+
+} // namespace
+
+
+
+
+std::vector<Byte> snapshot::serialize(const Snapshot& s) {
+
+    std::vector<Byte> out;
+    out.reserve(header_size + sizeof(Snapshot) + trailer_size);
+
+    Writer w{ out };
+    out.insert(out.end(), std::begin(magic), std::end(magic));
+    w.put(format_version);
+    w.put(std::uint16_t{ 0 });
+    w.put(std::uint32_t{ 0 }); // Body size, patched below
+
+    w.put(s.rng);
+    w.put(s.cycle_count);
+    w.put(s.frame);
+    w.put(s.memory);
+    w.put(s.V);
+    w.put(s.stack);
+    w.put(s.opcode);
+    w.put(s.I);
+    w.put(s.pc);
+    w.put(s.keys);
+    w.put(s.sp);
+    w.put(s.delay_timer);
+    w.put(s.sound_timer);
+    w.put(s.draw_flag);
+    w.put(s.buzzing);
+    w.put(s.fault);
+
+    const auto body_size = static_cast<std::uint32_t>(out.size() - header_size);
+    for (size_t i{ 0 }; i < 4; ++i) {
+        out[8 + i] = static_cast<Byte>(body_size >> (8 * i));
+    }
+
+    w.put(codec::fnv1a({ out.data() + header_size, body_size }));
+    return out;
+}
+
+
+
+Snapshot snapshot::deserialize(std::span<const Byte> data) {
+
+    if (data.size() < header_size + trailer_size ||
+        std::memcmp(data.data(), magic, sizeof(magic)) != 0)
+    {
+        throw std::runtime_error{ "Not a save state" };
+    }
+
+    Reader header{ data.subspan(4, header_size - 4) };
+    const auto version = header.get<std::uint16_t>();
+    header.get<std::uint16_t>(); // Flags
+    const auto body_size = header.get<std::uint32_t>();
+
+    if (version != format_version) {
+        throw std::runtime_error{
+            fmt::format("Unsupported save state version: {}", version)
+        };
+    }
+    if (data.size() != header_size + body_size + trailer_size) {
+        throw std::runtime_error{ "Save state size mismatch" };
+    }
+
+    const auto body = data.subspan(header_size, body_size);
+    Reader trailer{ data.subspan(header_size + body_size) };
+    if (trailer.get<std::uint64_t>() != codec::fnv1a(body)) {
+        throw std::runtime_error{ "Save state checksum mismatch" };
+    }
+
+    Snapshot s{};
+    Reader r{ body };
+    s.rng = r.get<std::uint64_t>();
+    s.cycle_count = r.get<std::uint64_t>();
+    r.get(s.frame);
+    r.get(s.memory);
+    r.get(s.V);
+    r.get(s.stack);
+    s.opcode = r.get<Short>();
+    s.I = r.get<Short>();
+    s.pc = r.get<Short>();
+    s.keys = r.get<std::uint16_t>();
+    s.sp = r.get<Byte>();
+    s.delay_timer = r.get<Byte>();
+    s.sound_timer = r.get<Byte>();
+    s.draw_flag = r.get<Byte>();
+    s.buzzing = r.get<Byte>();
+    s.fault = r.get<Byte>();
+
+    if (r.pos() != body.size()) {
+        throw std::runtime_error{ "Save state size mismatch" };
+    }
+    if (s.sp > s.stack.size() ||
+        s.fault > static_cast<Byte>(Chip8::Fault::stack_underflow))
+    {
+        throw std::runtime_error{ "Malformed save state" };
+    }
+    return s;
+}
+
+
+
+void snapshot::write(std::ostream& os, const Snapshot& s) {
+    const auto bytes = serialize(s);
+    os.write(reinterpret_cast<const char*>(bytes.data()),
+        static_cast<std::streamsize>(bytes.size()));
+    if (os.fail()) {
+        throw std::runtime_error{ "Unable to write save state" };
+    }
+}
+
+
+Snapshot snapshot::read(std::istream& is) {
+    const std::vector<Byte> bytes{
+        std::istreambuf_iterator<char>(is),
+        std::istreambuf_iterator<char>()
+    };
+    return deserialize(bytes);
+}
+
+
+
+std::uint64_t snapshot::hash(const Snapshot& s) noexcept {
+    return codec::fnv1a({ reinterpret_cast<const Byte*>(&s), sizeof(s) });
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "Chip8.hpp"
+#include <cstdint>
+#include <iosfwd>
+#include <span>
+#include <vector>
+
+
+// Versioned binary save state format:
+//   "C8SS" magic, u16 version, u16 flags (0), u32 body size,
+//   body (little-endian fields in Snapshot order), u64 FNV-1a of body
+namespace snapshot {
+
+constexpr std::uint16_t format_version{ 3 };
+
+
+std::vector<Byte> serialize(const Snapshot& s);
+
+// Throws std::runtime_error on bad magic, version,
+// size, checksum or out of range fields.
+Snapshot deserialize(std::span<const Byte> data);
+
+void write(std::ostream& os, const Snapshot& s);
+Snapshot read(std::istream& is);
+
+
+// Hash of the full state, stable across runs
+// on hosts of the same endianness.
+std::uint64_t hash(const Snapshot& s) noexcept;
+
+
+} // namespace snapshot
@@ -0,0 +1,466 @@
+#include "Spectator.hpp"
+#include "Codec.hpp"
+#include <fmt/format.h>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+namespace {
+
+constexpr char magic[4]{ 'C', '8', 'S', 'P' };
+constexpr size_t hello_size{ 10 };
+constexpr size_t ack_size{ 8 };
+
+
+std::runtime_error socket_error(std::string_view what) {
+    return std::runtime_error{ fmt::format("{}: {}", what, std::strerror(errno)) };
+}
+
+
+struct Address {
+    sockaddr_storage storage{};
+    socklen_t size{ 0 };
+    bool tcp{ false };
+    std::string unix_path;
+};
+
+Address parse_address(std::string_view spec) {
+    Address addr{};
+
+    if (spec.starts_with("tcp:")) {
+        unsigned long port{ 0 };
+        try {
+            port = std::stoul(std::string{ spec.substr(4) });
+        } catch (const std::logic_error&) {}
+        if (port == 0 || port > 0xFFFF) {
+            throw std::runtime_error{ "Invalid spectator port: " + std::string{ spec.substr(4) } };
+        }
+        auto* in = reinterpret_cast<sockaddr_in*>(&addr.storage);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(static_cast<std::uint16_t>(port));
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.size = sizeof(sockaddr_in);
+        addr.tcp = true;
+        return addr;
+    }
+
+    if (spec.starts_with("unix:")) {
+        auto* un = reinterpret_cast<sockaddr_un*>(&addr.storage);
+        addr.unix_path = spec.substr(5);
+        if (addr.unix_path.empty() || addr.unix_path.size() >= sizeof(un->sun_path)) {
+            throw std::runtime_error{ "Invalid spectator socket path: " + addr.unix_path };
+        }
+        un->sun_family = AF_UNIX;
+        std::memcpy(un->sun_path, addr.unix_path.c_str(), addr.unix_path.size() + 1);
+        addr.size = sizeof(sockaddr_un);
+        return addr;
+    }
+
+    throw std::runtime_error{ "Unknown spectator socket: " + std::string{ spec } };
+}
+
+
+// Sent once on connect
+constexpr std::array<Byte, hello_size> hello{
+    magic[0], magic[1], magic[2], magic[3],
+    static_cast<Byte>(spectator::protocol_version), static_cast<Byte>(spectator::protocol_version >> 8),
+    static_cast<Byte>(Chip8Base::fb_width), static_cast<Byte>(Chip8Base::fb_width >> 8),
+    static_cast<Byte>(Chip8Base::fb_height), static_cast<Byte>(Chip8Base::fb_height >> 8),
+};
+
+} // namespace
+
+
+
+
+struct spectator::Server::Connection {
+    int fd{ -1 };
+    // Closed while handling this batch of events, kept alive until
+    // the batch is done so later events for it can be told apart
+    bool closed{ false };
+
+    std::vector<Byte> out;
+    size_t out_pos{ 0 };
+    bool want_write{ false };
+
+    std::array<Byte, ack_size> in{};
+    size_t in_size{ 0 };
+
+    // Last acknowledged frame, the base of the next delta
+    std::uint64_t base_sequence{ 0 };
+    framestream::Packed base{};
+
+    // Frame in flight, 0 if none
+    std::uint64_t sent_sequence{ 0 };
+    framestream::Packed sent{};
+};
+
+
+
+spectator::Server::Server(std::string_view spec, size_t max_clients) :
+    max_clients_{ max_clients }
+{
+    const Address addr{ parse_address(spec) };
+
+    try {
+        listen_fd_ = ::socket(addr.storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) { throw socket_error("Unable to create spectator socket"); }
+
+        if (addr.tcp) {
+            const int on{ 1 };
+            ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        } else {
+            // Left over from an earlier run
+            ::unlink(addr.unix_path.c_str());
+        }
+
+        if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&addr.storage), addr.size) != 0) {
+            throw socket_error(fmt::format("Unable to bind {}", spec));
+        }
+        unix_path_ = addr.unix_path;
+
+        if (::listen(listen_fd_, 128) != 0) { throw socket_error("Unable to listen"); }
+
+        wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        if (wake_fd_ < 0 || epoll_fd_ < 0) { throw socket_error("Unable to set up event loop"); }
+
+        // Events carry a pointer, these two point at their fd member
+        for (int* fd : { &listen_fd_, &wake_fd_ }) {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.ptr = fd;
+            ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, *fd, &ev);
+        }
+    } catch (...) {
+        for (int fd : { listen_fd_, wake_fd_, epoll_fd_ }) {
+            if (fd >= 0) { ::close(fd); }
+        }
+        if (!unix_path_.empty()) { ::unlink(unix_path_.c_str()); }
+        throw;
+    }
+
+    thread_ = std::thread{ [this] { run(); } };
+}
+
+
+spectator::Server::~Server() {
+    stop_.store(true);
+    const std::uint64_t one{ 1 };
+    [[maybe_unused]] auto _ = ::write(wake_fd_, &one, sizeof(one));
+    thread_.join();
+
+    ::close(epoll_fd_);
+    ::close(wake_fd_);
+    ::close(listen_fd_);
+    if (!unix_path_.empty()) { ::unlink(unix_path_.c_str()); }
+}
+
+
+void spectator::Server::publish(const Chip8::framebuffer_t& fb) {
+    {
+        std::lock_guard lock{ mutex_ };
+        framestream::pack(fb, latest_);
+        ++latest_sequence_;
+    }
+    const std::uint64_t one{ 1 };
+    [[maybe_unused]] auto _ = ::write(wake_fd_, &one, sizeof(one));
+}
+
+
+
+void spectator::Server::run() {
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    // Closed during the current batch of events
+    std::vector<std::unique_ptr<Connection>> closed;
+
+    // Latest frame as seen by this thread
+    framestream::Packed frame{};
+    std::uint64_t sequence{ 0 };
+    // Payloads of the current frame by base sequence,
+    // clients with the same base share one encoding
+    std::unordered_map<std::uint64_t, std::vector<Byte>> payloads;
+    const framestream::Packed blank{};
+
+    auto set_write_interest = [&](Connection& c, bool want) {
+        if (c.want_write == want) { return; }
+        c.want_write = want;
+        epoll_event ev{};
+        ev.events = EPOLLIN | (want ? EPOLLOUT : 0u);
+        ev.data.ptr = &c;
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &ev);
+    };
+
+    // The fd may be reused by the next accept, so events still
+    // pending for it are recognized by the closed flag instead
+    auto close_connection = [&](Connection& c) {
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, c.fd, nullptr);
+        ::close(c.fd);
+        c.closed = true;
+        auto it = connections.find(c.fd);
+        closed.push_back(std::move(it->second));
+        connections.erase(it);
+        clients_.fetch_sub(1, std::memory_order_relaxed);
+    };
+
+    // False if the connection broke
+    auto flush = [&](Connection& c) {
+        while (c.out_pos < c.out.size()) {
+            const auto n = ::send(c.fd, c.out.data() + c.out_pos, c.out.size() - c.out_pos,
+                MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    set_write_interest(c, true);
+                    return true;
+                }
+                if (errno == EINTR) { continue; }
+                return false;
+            }
+            c.out_pos += static_cast<size_t>(n);
+            bytes_sent_.fetch_add(static_cast<std::uint64_t>(n), std::memory_order_relaxed);
+        }
+        c.out.clear();
+        c.out_pos = 0;
+        set_write_interest(c, false);
+        return true;
+    };
+
+    // Sends the latest frame if the client is ready for one
+    auto offer = [&](Connection& c) {
+        if (c.sent_sequence || !c.out.empty() || c.base_sequence == sequence) { return true; }
+
+        auto [it, inserted] = payloads.try_emplace(c.base_sequence);
+        if (inserted) {
+            codec::encode_xor(c.base_sequence ? c.base : blank, frame, it->second);
+        }
+        const auto& payload = it->second;
+
+        std::vector<Byte> body;
+        codec::put_varint(body, sequence);
+        codec::put_varint(body, c.base_sequence);
+        codec::put_varint(c.out, body.size() + payload.size());
+        c.out.insert(c.out.end(), body.begin(), body.end());
+        c.out.insert(c.out.end(), payload.begin(), payload.end());
+
+        c.sent = frame;
+        c.sent_sequence = sequence;
+        frames_sent_.fetch_add(1, std::memory_order_relaxed);
+        return flush(c);
+    };
+
+    auto accept_all = [&] {
+        for (;;) {
+            const int fd{ ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) };
+            if (fd < 0) { return; }
+
+            if (connections.size() >= max_clients_) {
+                ::close(fd);
+                continue;
+            }
+            const int on{ 1 };
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            auto conn = std::make_unique<Connection>();
+            conn->fd = fd;
+            conn->out.assign(hello.begin(), hello.end());
+
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.ptr = conn.get();
+            ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+
+            Connection& c = *conn;
+            connections.emplace(fd, std::move(conn));
+            clients_.fetch_add(1, std::memory_order_relaxed);
+
+            if (!flush(c) || !offer(c)) { close_connection(c); }
+        }
+    };
+
+    // False if the connection broke or misbehaved
+    auto receive = [&](Connection& c) {
+        for (;;) {
+            const auto n = ::recv(c.fd, c.in.data() + c.in_size, ack_size - c.in_size, MSG_DONTWAIT);
+            if (n == 0) { return false; }
+            if (n < 0) {
+                if (errno == EINTR) { continue; }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            c.in_size += static_cast<size_t>(n);
+            if (c.in_size < ack_size) { continue; }
+
+            std::uint64_t ack{ 0 };
+            for (size_t i{ 0 }; i < ack_size; ++i) {
+                ack |= std::uint64_t{ c.in[i] } << (8 * i);
+            }
+            c.in_size = 0;
+
+            if (ack != c.sent_sequence) { return false; }
+            c.base = c.sent;
+            c.base_sequence = ack;
+            c.sent_sequence = 0;
+            if (!offer(c)) { return false; }
+        }
+    };
+
+
+    std::array<epoll_event, 64> events{};
+    while (!stop_.load(std::memory_order_relaxed)) {
+        const int count{ ::epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), -1) };
+        if (count < 0) {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+
+        for (int i{ 0 }; i < count; ++i) {
+            void* const target{ events[i].data.ptr };
+
+            if (target == &listen_fd_) {
+                accept_all();
+                continue;
+            }
+
+            if (target == &wake_fd_) {
+                std::uint64_t value{ 0 };
+                [[maybe_unused]] auto _ = ::read(wake_fd_, &value, sizeof(value));
+                {
+                    std::lock_guard lock{ mutex_ };
+                    if (latest_sequence_ == sequence) { continue; }
+                    frame = latest_;
+                    sequence = latest_sequence_;
+                }
+                payloads.clear();
+
+                std::vector<Connection*> broken;
+                for (auto& [cfd, c] : connections) {
+                    if (!offer(*c)) { broken.push_back(c.get()); }
+                }
+                for (Connection* b : broken) { close_connection(*b); }
+                continue;
+            }
+
+            Connection& c = *static_cast<Connection*>(target);
+            if (c.closed) { continue; }
+
+            bool ok{ true };
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) { ok = false; }
+            if (ok && (events[i].events & EPOLLOUT)) { ok = flush(c) && offer(c); }
+            if (ok && (events[i].events & EPOLLIN)) { ok = receive(c); }
+            if (!ok) { close_connection(c); }
+        }
+        closed.clear();
+    }
+
+    for (auto& [fd, c] : connections) {
+        ::close(fd);
+    }
+    clients_.store(0, std::memory_order_relaxed);
+}
+
+
+
+
+
+spectator::Client::Client(std::string_view spec) {
+    const Address addr{ parse_address(spec) };
+
+    fd_ = ::socket(addr.storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) { throw socket_error("Unable to create socket"); }
+
+    if (::connect(fd_, reinterpret_cast<const sockaddr*>(&addr.storage), addr.size) != 0) {
+        const auto error = socket_error(fmt::format("Unable to connect to {}", spec));
+        ::close(fd_);
+        throw error;
+    }
+
+    if (!fill(hello_size) ||
+        std::memcmp(in_.data(), magic, sizeof(magic)) != 0 ||
+        (in_[4] | in_[5] << 8) != protocol_version ||
+        (in_[6] | in_[7] << 8) != Chip8Base::fb_width ||
+        (in_[8] | in_[9] << 8) != Chip8Base::fb_height)
+    {
+        ::close(fd_);
+        throw std::runtime_error{ "Not a compatible spectator server" };
+    }
+    in_pos_ = hello_size;
+}
+
+
+spectator::Client::~Client() {
+    ::close(fd_);
+}
+
+
+bool spectator::Client::fill(size_t size) {
+    // Drop what's been consumed
+    in_.erase(in_.begin(), in_.begin() + static_cast<std::ptrdiff_t>(in_pos_));
+    in_pos_ = 0;
+
+    std::array<Byte, 4096> buffer;
+    while (in_.size() < size) {
+        const auto n = ::recv(fd_, buffer.data(), buffer.size(), 0);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+        in_.insert(in_.end(), buffer.begin(), buffer.begin() + n);
+    }
+    return true;
+}
+
+
+std::optional<spectator::Frame> spectator::Client::next() {
+
+    // Size prefix, a varint of at most 10 bytes
+    std::optional<std::uint64_t> size{};
+    for (;;) {
+        size_t pos{ in_pos_ };
+        size = codec::get_varint(in_, pos);
+        if (size) {
+            in_pos_ = pos;
+            break;
+        }
+        if (in_.size() - in_pos_ >= 10) {
+            throw std::runtime_error{ "Malformed spectator frame" };
+        }
+        if (!fill(in_.size() - in_pos_ + 1)) { return {}; }
+    }
+
+    if (in_.size() - in_pos_ < *size && !fill(*size)) { return {}; }
+    const std::span<const Byte> body{ in_.data() + in_pos_, *size };
+    in_pos_ += *size;
+
+    size_t pos{ 0 };
+    const auto sequence = codec::get_varint(body, pos);
+    const auto base = codec::get_varint(body, pos);
+    if (!sequence || !base || (*base != 0 && *base != sequence_)) {
+        throw std::runtime_error{ "Malformed spectator frame" };
+    }
+
+    if (*base == 0) { frame_.fill(0); }
+    if (!codec::apply_xor(body.subspan(pos), frame_)) {
+        throw std::runtime_error{ "Malformed spectator frame" };
+    }
+    sequence_ = *sequence;
+
+    std::array<Byte, ack_size> ack;
+    for (size_t i{ 0 }; i < ack_size; ++i) {
+        ack[i] = static_cast<Byte>(sequence_ >> (8 * i));
+    }
+    if (::send(fd_, ack.data(), ack.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(ack.size())) {
+        return {};
+    }
+
+    Frame frame{ sequence_, {} };
+    framestream::unpack(frame_, frame.rows);
+    return frame;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "Chip8.hpp"
+#include "FrameStream.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+// Live frames for local viewers over a TCP or Unix stream socket.
+//
+// Server to client (integers little-endian):
+//   Hello: "C8SP", u16 version, u16 width, u16 height
+//   Frame: varint body size, then body: varint sequence,
+//          varint base sequence (0 for a blank frame), payload.
+//          Payload is codec::encode_xor() of the packed frame
+//          (see framestream::pack()) against the base.
+// Client to server:
+//   Ack: u64 sequence, once the frame is applied
+//
+// Each client has at most one unacknowledged frame and the next one
+// is a delta against its last acknowledged frame. Frames published
+// in the meantime are skipped, so slow clients never pile up data.
+// Uses epoll, Linux only.
+namespace spectator {
+
+constexpr std::uint16_t protocol_version{ 1 };
+
+
+class Server {
+private:
+    struct Connection;
+
+    int listen_fd_{ -1 };
+    int wake_fd_{ -1 };
+    int epoll_fd_{ -1 };
+    std::string unix_path_;
+    size_t max_clients_;
+
+    std::mutex mutex_;
+    framestream::Packed latest_{};
+    std::uint64_t latest_sequence_{ 0 };
+
+    std::atomic<bool> stop_{ false };
+    std::atomic<size_t> clients_{ 0 };
+    std::atomic<std::uint64_t> frames_sent_{ 0 };
+    std::atomic<std::uint64_t> bytes_sent_{ 0 };
+
+    std::thread thread_;
+
+public:
+    // Listens on "tcp:<port>" (localhost only) or "unix:<path>".
+    // Throws std::runtime_error if the socket can't be set up.
+    explicit Server(std::string_view spec, size_t max_clients = 1024);
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    ~Server();
+
+    // Make fb the latest frame. Cheap and never waits on clients.
+    void publish(const Chip8::framebuffer_t& fb);
+
+    size_t clients() const noexcept { return clients_.load(std::memory_order_relaxed); }
+    std::uint64_t frames_sent() const noexcept { return frames_sent_.load(std::memory_order_relaxed); }
+    std::uint64_t bytes_sent() const noexcept { return bytes_sent_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+};
+
+
+
+struct Frame {
+    std::uint64_t sequence{};
+    Chip8::framebuffer_t rows{};
+};
+
+
+// Blocking viewer, acknowledges every frame it returns
+class Client {
+private:
+    int fd_{ -1 };
+    std::vector<Byte> in_;
+    size_t in_pos_{ 0 };
+    framestream::Packed frame_{};
+    std::uint64_t sequence_{ 0 };
+
+public:
+    // Connects to a Server spec.
+    // Throws std::runtime_error on failure or a bad hello.
+    explicit Client(std::string_view spec);
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    ~Client();
+
+    // Nullopt once the server closes the connection.
+    // Throws std::runtime_error on a malformed frame.
+    std::optional<Frame> next();
+
+private:
+    bool fill(size_t size);
+};
+
+
+} // namespace spectator
@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+
+// Bounded lock-free single-producer/single-consumer ring.
+// Storage is inline, so pushing and popping never allocate.
+template<typename T, size_t Capacity>
+class SpscQueue {
+private:
+    static_assert(Capacity > 1 && (Capacity & (Capacity - 1)) == 0,
+        "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    static constexpr size_t mask_{ Capacity - 1 };
+    static constexpr size_t cache_line_{ 64 };
+
+    std::array<T, Capacity> buffer_{};
+
+    // Producer and consumer indices live on separate cache lines
+    alignas(cache_line_) std::atomic<size_t> head_{ 0 }; // Next to pop
+    alignas(cache_line_) std::atomic<size_t> tail_{ 0 }; // Next to push
+
+public:
+    // Producer side. Returns false if the queue is full.
+    bool try_push(const T& value) noexcept {
+        const size_t tail{ tail_.load(std::memory_order_relaxed) };
+        if (tail - head_.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        buffer_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool try_pop(T& out) noexcept {
+        const size_t head{ head_.load(std::memory_order_relaxed) };
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = buffer_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const noexcept {
+        return head_.load(std::memory_order_acquire) ==
+            tail_.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity() noexcept { return Capacity; }
+};
@@ -0,0 +1,224 @@
+#include "ThreadPool.hpp"
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+
+namespace {
+
+constexpr std::uint64_t pack(std::uint64_t begin, std::uint64_t end) noexcept {
+    return begin | (end << 32);
+}
+
+constexpr std::uint64_t range_begin(std::uint64_t range) noexcept {
+    return range & 0xFFFFFFFFu;
+}
+
+constexpr std::uint64_t range_end(std::uint64_t range) noexcept {
+    return range >> 32;
+}
+
+std::int64_t elapsed_ns(std::chrono::steady_clock::time_point since) noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - since
+    ).count();
+}
+
+} // namespace
+
+
+
+
+ThreadPool::ThreadPool(size_t threads) :
+    slots_{ std::make_unique<Slot[]>(threads + 1) }
+{
+    workers_.reserve(threads);
+    for (size_t i{ 0 }; i < threads; ++i) {
+        workers_.emplace_back([this, i] { worker_loop(i); });
+    }
+}
+
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock{ mutex_ };
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+
+
+void ThreadPool::run(const Job& job) {
+    if (job.size == 0) { return; }
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t self{ workers_.size() };
+
+    if (workers_.empty() || job.size <= job.chunk) {
+        job.invoke(job.fn, 0, job.size);
+        slots_[self].chunks.fetch_add(1, std::memory_order_relaxed);
+        slots_[self].busy_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+        wall_ns_.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+        return;
+    }
+
+    const size_t chunks{ (job.size + job.chunk - 1) / job.chunk };
+    if (chunks > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::length_error{ "parallel_for: too many chunks" };
+    }
+
+    {
+        std::lock_guard lock{ mutex_ };
+        job_ = job;
+        // Even split, the mutex publishes it to the workers
+        const size_t n{ slot_count() };
+        for (size_t i{ 0 }; i < n; ++i) {
+            slots_[i].range.store(
+                pack(chunks * i / n, chunks * (i + 1) / n),
+                std::memory_order_relaxed
+            );
+        }
+        joined_ = 0;
+        error_ = nullptr;
+        failed_.store(false, std::memory_order_relaxed);
+        ++generation_;
+    }
+    work_cv_.notify_all();
+
+    work(job, self);
+
+    // Every worker must be done with this job before the next
+    // one resets the deques, and job.fn must outlive their use of it
+    std::unique_lock lock{ mutex_ };
+    done_cv_.wait(lock, [this] {
+        return joined_ == workers_.size() && active_ == 0;
+    });
+
+    wall_ns_.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+    if (error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+
+void ThreadPool::work(const Job& job, size_t self) {
+    const auto start = std::chrono::steady_clock::now();
+    Slot& own = slots_[self];
+    const size_t n{ slot_count() };
+
+    std::uint64_t done{ 0 };
+    std::uint64_t steals{ 0 };
+
+    auto run_chunk = [&](std::uint64_t c) {
+        // Chunks are still taken after a failure, so the deques drain
+        if (failed_.load(std::memory_order_relaxed)) { return; }
+
+        const size_t begin{ c * job.chunk };
+        try {
+            job.invoke(job.fn, begin, std::min(begin + job.chunk, job.size));
+        } catch (...) {
+            std::lock_guard lock{ mutex_ };
+            if (!error_) { error_ = std::current_exception(); }
+            failed_.store(true, std::memory_order_relaxed);
+            return;
+        }
+        ++done;
+    };
+
+    for (;;) {
+        // Drain own deque from the front
+        std::uint64_t range{ own.range.load(std::memory_order_acquire) };
+        while (range_begin(range) < range_end(range)) {
+            const std::uint64_t next{ pack(range_begin(range) + 1, range_end(range)) };
+            if (own.range.compare_exchange_weak(range, next, std::memory_order_acq_rel)) {
+                run_chunk(range_begin(range));
+                range = next;
+            }
+        }
+
+        // Steal the back half of the first non-empty deque
+        bool stolen{ false };
+        for (size_t i{ 1 }; i < n && !stolen; ++i) {
+            Slot& victim = slots_[(self + i) % n];
+            std::uint64_t theirs{ victim.range.load(std::memory_order_acquire) };
+            while (range_begin(theirs) < range_end(theirs)) {
+                const std::uint64_t b{ range_begin(theirs) };
+                const std::uint64_t e{ range_end(theirs) };
+                const std::uint64_t split{ e - (e - b + 1) / 2 };
+                if (victim.range.compare_exchange_weak(
+                        theirs, pack(b, split), std::memory_order_acq_rel))
+                {
+                    // Run the first stolen chunk, offer the rest
+                    own.range.store(pack(split + 1, e), std::memory_order_release);
+                    run_chunk(split);
+                    ++steals;
+                    stolen = true;
+                    break;
+                }
+            }
+        }
+
+        // Chunks moving between deques mid-scan can be missed,
+        // but whoever holds them will run them
+        if (!stolen) { break; }
+    }
+
+    own.chunks.fetch_add(done, std::memory_order_relaxed);
+    own.steals.fetch_add(steals, std::memory_order_relaxed);
+    own.busy_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+}
+
+
+void ThreadPool::worker_loop(size_t self) {
+    std::uint64_t seen{ 0 };
+
+    std::unique_lock lock{ mutex_ };
+    for (;;) {
+        work_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_) { return; }
+
+        seen = generation_;
+        const Job job{ job_ };
+        ++joined_;
+        ++active_;
+        lock.unlock();
+
+        work(job, self);
+
+        lock.lock();
+        if (--active_ == 0) {
+            done_cv_.notify_all();
+        }
+    }
+}
+
+
+
+std::vector<ThreadPool::WorkerStats> ThreadPool::stats() const {
+    const auto wall = wall_ns_.load(std::memory_order_relaxed);
+
+    std::vector<WorkerStats> out(slot_count());
+    for (size_t i{ 0 }; i < out.size(); ++i) {
+        const Slot& slot = slots_[i];
+        const auto busy = slot.busy_ns.load(std::memory_order_relaxed);
+        out[i].chunks = slot.chunks.load(std::memory_order_relaxed);
+        out[i].steals = slot.steals.load(std::memory_order_relaxed);
+        out[i].busy = std::chrono::nanoseconds{ busy };
+        out[i].utilization = wall ? std::min(1.0, double(busy) / double(wall)) : 0.0;
+    }
+    return out;
+}
+
+
+void ThreadPool::reset_stats() noexcept {
+    for (size_t i{ 0 }; i < slot_count(); ++i) {
+        slots_[i].chunks.store(0, std::memory_order_relaxed);
+        slots_[i].steals.store(0, std::memory_order_relaxed);
+        slots_[i].busy_ns.store(0, std::memory_order_relaxed);
+    }
+    wall_ns_.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+// Fixed set of worker threads for data-parallel loops.
+// parallel_for() blocks until the loop is done and
+// does not allocate per call.
+//
+// Loops are load-balanced by work stealing: every thread starts
+// with an equal share of the chunks in its own deque, works it from
+// the front, and once empty steals half of what's left at the back
+// of another thread's deque. Uneven chunks (instances blocked on
+// input next to draw-heavy ones) then don't leave threads idle.
+class ThreadPool {
+public:
+    struct WorkerStats {
+        std::uint64_t chunks{};
+        std::uint64_t steals{};
+        std::chrono::nanoseconds busy{};
+        // Fraction of the time spent in parallel_for() this thread was working
+        double utilization{};
+    };
+
+private:
+    using invoke_t = void(*)(void* fn, size_t begin, size_t end);
+
+    struct Job {
+        size_t size{ 0 };
+        size_t chunk{ 1 };
+        invoke_t invoke{ nullptr };
+        void* fn{ nullptr };
+    };
+
+    // Deque of chunk indices [begin, end) packed into one word,
+    // begin in the low half. A thief always runs the first chunk it
+    // takes, so an old range value can't come back and CAS is ABA-safe.
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> range{ 0 };
+        std::atomic<std::uint64_t> chunks{ 0 };
+        std::atomic<std::uint64_t> steals{ 0 };
+        std::atomic<std::int64_t> busy_ns{ 0 };
+    };
+
+    std::vector<std::thread> workers_;
+    // One per worker, the caller's is last
+    std::unique_ptr<Slot[]> slots_;
+
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::uint64_t generation_{ 0 };
+    // Workers that picked up the current job, and those still in it
+    size_t joined_{ 0 };
+    size_t active_{ 0 };
+    bool stop_{ false };
+
+    Job job_{};
+    // First exception thrown by the current job, the rest of its
+    // chunks are skipped once set
+    std::exception_ptr error_{};
+    std::atomic<bool> failed_{ false };
+    std::atomic<std::int64_t> wall_ns_{ 0 };
+
+public:
+    // Zero threads means the caller runs everything itself
+    explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool();
+
+    // Calls fn(begin, end) over [0, size) in chunks of at most chunk.
+    // The calling thread takes part in the work. If fn throws, the
+    // chunks not started yet are skipped and the first exception is
+    // rethrown once every thread is done with the loop.
+    template<typename F>
+    void parallel_for(size_t size, size_t chunk, F&& fn) {
+        using fn_t = std::remove_reference_t<F>;
+        run(Job{
+            size, std::max<size_t>(chunk, 1),
+            [](void* f, size_t begin, size_t end) {
+                (*static_cast<fn_t*>(f))(begin, end);
+            },
+            const_cast<void*>(static_cast<const void*>(&fn))
+        });
+    }
+
+    size_t size() const noexcept { return workers_.size(); }
+
+    // One entry per worker, followed by the calling thread.
+    // Accumulated since construction or the last reset_stats().
+    std::vector<WorkerStats> stats() const;
+    void reset_stats() noexcept;
+
+private:
+    void run(const Job& job);
+    void work(const Job& job, size_t self);
+    void worker_loop(size_t self);
+
+    size_t slot_count() const noexcept { return workers_.size() + 1; }
+};
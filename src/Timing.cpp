@@ -0,0 +1,39 @@
+#include "Timing.hpp"
+
+
+
+unsigned timing::cost(Short opcode, bool skipped) noexcept {
+    // Taken skips cost the extra fetch of the skipped instruction
+    const unsigned skip{ skipped ? 4u : 0u };
+    const unsigned X{ (opcode & 0x0F00u) >> 8 };
+    const unsigned N{ opcode & 0x000Fu };
+
+    switch (opcode & 0xF000) {
+        case 0x0000: return opcode == 0x00E0 ? 24 : 23;
+        case 0x1000: return 23;
+        case 0x2000: return 26;
+        case 0x3000:
+        case 0x4000: return 10 + skip;
+        case 0x5000:
+        case 0x9000: return 14 + skip;
+        case 0x6000: return 6;
+        case 0x7000: return 10;
+        case 0x8000: return 44;
+        case 0xA000: return 12;
+        case 0xB000: return 23;
+        case 0xC000: return 36;
+        case 0xD000: return 26 + 10 * N;
+        case 0xE000: return 16 + skip;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x001E: return 19;
+                case 0x0029: return 20;
+                // BCD by repeated subtraction
+                case 0x0033: return 204;
+                case 0x0055:
+                case 0x0065: return 18 + 8 * (X + 1);
+                default:     return 10;
+            }
+    }
+    return 10;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "Chip8.hpp"
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+
+// Cycle-accurate timing modelled on the COSMAC VIP interpreter.
+//
+// Time is counted in VIP machine cycles (8 clocks of the 1.76 MHz
+// CPU). Every instruction costs what it took the original interpreter,
+// and DXYN draws and then waits for the next vblank, so the frame
+// presented at that vblank already shows the sprite. Timer ticks and
+// vblank fire from a scheduler at exact emulated cycles, so the result
+// doesn't depend on how fast or how often the host runs the loop.
+namespace timing {
+
+constexpr std::uint64_t cycles_per_second{ 1'760'640 / 8 };
+constexpr std::uint64_t cycles_per_frame{ cycles_per_second / 60 };
+
+
+// Machine cycles of an executed instruction, skipped tells whether
+// a conditional skip was taken. Averages where the VIP's time
+// depends on the operands, DXYN excludes the wait for vblank.
+unsigned cost(Short opcode, bool skipped) noexcept;
+
+
+// Fixed set of periodic events, each due at an absolute cycle
+class Scheduler {
+public:
+    enum class Event : Byte { timer_tick, vblank };
+    static constexpr size_t event_count{ 2 };
+
+    static constexpr std::uint64_t never{ std::numeric_limits<std::uint64_t>::max() };
+
+private:
+    std::array<std::uint64_t, event_count> due_{ never, never };
+    std::array<std::uint64_t, event_count> period_{};
+
+public:
+    // Period of 0 fires once
+    void schedule(Event event, std::uint64_t at, std::uint64_t period = 0) noexcept {
+        due_[static_cast<size_t>(event)] = at;
+        period_[static_cast<size_t>(event)] = period;
+    }
+
+    void cancel(Event event) noexcept { schedule(event, never); }
+
+    std::uint64_t due(Event event) const noexcept {
+        return due_[static_cast<size_t>(event)];
+    }
+
+    // Earliest event due at or before now, rescheduled by its period.
+    // Events due at the same cycle come out in enum order.
+    std::optional<Event> pop(std::uint64_t now) noexcept {
+        size_t first{ event_count };
+        for (size_t i{ 0 }; i < event_count; ++i) {
+            if (due_[i] <= now && (first == event_count || due_[i] < due_[first])) {
+                first = i;
+            }
+        }
+        if (first == event_count) { return {}; }
+
+        due_[first] = period_[first] ? due_[first] + period_[first] : never;
+        return static_cast<Event>(first);
+    }
+};
+
+
+
+// Drives a Chip8 in emulated time. Small and copyable.
+// Its phase isn't part of a Snapshot: callers replace the clock with
+// a fresh one whenever they load a state, so the loaded state starts
+// a new frame, as VecEnv does on reset.
+class Clock {
+private:
+    std::uint64_t now_{ 0 };
+    Scheduler scheduler_{};
+
+public:
+    Clock() noexcept {
+        scheduler_.schedule(Scheduler::Event::timer_tick, cycles_per_frame, cycles_per_frame);
+        scheduler_.schedule(Scheduler::Event::vblank, cycles_per_frame, cycles_per_frame);
+    }
+
+    // Execute one instruction and advance time by its cost,
+    // ticking the timers on the way. Returns true if a vblank
+    // was crossed, the frame is then ready to be presented.
+    bool step(Chip8& chip8) {
+        const Short pc{ chip8.get_pc() };
+        chip8.emulate_cycle();
+        const Short opcode{ chip8.get_opcode() };
+
+        bool vblank{ false };
+        if ((opcode & 0xF000) == 0xD000) {
+            // Display wait, the sprite is already drawn and shows
+            // in the frame presented at this vblank
+            vblank = advance(chip8, scheduler_.due(Scheduler::Event::vblank));
+        }
+        const bool skipped{ chip8.get_pc() == static_cast<Short>(pc + 4u) };
+        return advance(chip8, now_ + cost(opcode, skipped)) || vblank;
+    }
+
+    // Step until the next vblank
+    void run_frame(Chip8& chip8) {
+        while (!step(chip8)) {}
+    }
+
+    std::uint64_t now() const noexcept { return now_; }
+    const Scheduler& scheduler() const noexcept { return scheduler_; }
+
+private:
+    bool advance(Chip8& chip8, std::uint64_t to) noexcept {
+        now_ = std::max(now_, to);
+
+        bool vblank{ false };
+        while (auto event = scheduler_.pop(now_)) {
+            switch (*event) {
+                case Scheduler::Event::timer_tick: chip8.update_timers(); break;
+                case Scheduler::Event::vblank:     vblank = true; break;
+            }
+        }
+        return vblank;
+    }
+};
+
+
+} // namespace timing
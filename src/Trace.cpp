@@ -0,0 +1,442 @@
+#include "Trace.hpp"
+#include "Codec.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+constexpr char magic[4]{ 'C', '8', 'T', 'R' };
+constexpr char index_magic[4]{ 'C', '8', 'T', 'I' };
+constexpr size_t header_size{ 8 };
+constexpr size_t trailer_size{ 8 };
+
+// V0..VF, I and pc
+constexpr size_t block_header_size{ 16 + 2 + 2 };
+// Zig-zag pc delta, opcode, mask, all of V and I, at most
+constexpr size_t max_record_size{ 3 + 2 + 3 + 16 + 3 };
+
+constexpr size_t flush_threshold{ 256 * 1024 };
+
+
+template<typename UInt>
+void put_le(std::vector<Byte>& out, UInt v) {
+    for (size_t i{ 0 }; i < sizeof(UInt); ++i) {
+        out.push_back(static_cast<Byte>(v >> (8 * i)));
+    }
+}
+
+template<typename UInt>
+UInt get_le(std::span<const Byte> in) noexcept {
+    UInt v{ 0 };
+    for (size_t i{ 0 }; i < sizeof(UInt); ++i) {
+        v |= static_cast<UInt>(UInt{ in[i] } << (8 * i));
+    }
+    return v;
+}
+
+
+// Memory written by an instruction, given I before it
+std::pair<Short, Byte> implied_write(Short opcode, Short I) noexcept {
+    switch (opcode & 0xF0FF) {
+        case 0xF033: return { I, 3 };
+        case 0xF055: return { I, static_cast<Byte>(((opcode & 0x0F00) >> 8) + 1) };
+        default:     return { I, 0 };
+    }
+}
+
+
+void account(trace::BlockInfo& info, const trace::Step& step) noexcept {
+    info.pc_pages |= trace::pages(step.pc, 1);
+    info.written_pages |= trace::pages(step.write_address, step.write_size);
+    info.opcode_groups |= static_cast<std::uint16_t>(1u << (step.opcode >> 12));
+    info.changed |= step.changed;
+    ++info.count;
+}
+
+} // namespace
+
+
+
+
+std::uint64_t trace::pages(Short address, size_t size) noexcept {
+    std::uint64_t bits{ 0 };
+    for (size_t i{ 0 }; i < size; ++i) {
+        bits |= std::uint64_t{ 1 } << ((address + i) % Chip8Base::memory_size >> 6);
+    }
+    return bits;
+}
+
+
+
+
+
+trace::Writer::Writer(const std::string& path, std::uint16_t block_size) :
+    block_size_{ block_size ? block_size : std::uint16_t{ 1 } },
+    file_{ path, std::ios_base::binary | std::ios_base::trunc }
+{
+    if (file_.fail()) {
+        throw std::runtime_error{ "Unable to create trace: " + path };
+    }
+    buffer_.reserve(2 * flush_threshold);
+    block_.raw.reserve(block_header_size + block_size_ * max_record_size);
+
+    buffer_.insert(buffer_.end(), std::begin(magic), std::end(magic));
+    put_le(buffer_, format_version);
+    put_le(buffer_, block_size_);
+    flush();
+
+    thread_ = std::thread{ [this] { write_loop(); } };
+}
+
+
+trace::Writer::~Writer() {
+    finish();
+}
+
+
+void trace::Writer::sync(const Chip8& c8) {
+    submit();
+    V_ = c8.get_registers();
+    I_ = c8.get_index();
+    next_cycle_ = c8.get_cycle_count();
+}
+
+
+void trace::Writer::record(Short pc, const Chip8& c8) {
+    const std::uint64_t cycle{ c8.get_cycle_count() };
+    if (cycle == next_cycle_ || !thread_.joinable()) { return; }
+    if (cycle != next_cycle_ + 1) {
+        // State replaced without sync(), the registers before this
+        // instruction are unknown. Start the new block from the ones
+        // after it rather than from stale ones, which would show up as
+        // changes and put FX33/FX55 writes at the old I. Neither changes I.
+        submit();
+        V_ = c8.get_registers();
+        I_ = c8.get_index();
+    }
+    next_cycle_ = cycle;
+
+    auto& raw = block_.raw;
+    auto& info = block_.info;
+    if (info.count == 0) {
+        info.first_cycle = cycle - 1;
+        raw.insert(raw.end(), V_.begin(), V_.end());
+        put_le(raw, I_);
+        put_le(raw, pc);
+        next_pc_ = pc;
+    }
+
+    const Short opcode{ c8.get_opcode() };
+    const auto& V = c8.get_registers();
+    const Short I{ c8.get_index() };
+
+    std::uint32_t changed{ 0 };
+    for (size_t x{ 0 }; x < V.size(); ++x) {
+        if (V[x] != V_[x]) { changed |= 1u << x; }
+    }
+    if (I != I_) { changed |= changed_index; }
+
+    codec::put_varint(raw, codec::zigzag(std::int64_t{ pc } - std::int64_t{ next_pc_ }));
+    raw.push_back(static_cast<Byte>(opcode >> 8));
+    raw.push_back(static_cast<Byte>(opcode));
+    codec::put_varint(raw, changed);
+    for (size_t x{ 0 }; x < V.size(); ++x) {
+        if (changed & (1u << x)) { raw.push_back(V[x]); }
+    }
+    if (changed & changed_index) { codec::put_varint(raw, I); }
+
+    const auto [address, size] = implied_write(opcode, I_);
+    account(info, Step{ cycle - 1, pc, opcode, V, I, changed, address, size });
+
+    V_ = V;
+    I_ = I;
+    next_pc_ = static_cast<Short>(pc + 2u);
+
+    if (info.count == block_size_) { submit(); }
+}
+
+
+void trace::Writer::submit() {
+    if (block_.info.count == 0) { return; }
+    {
+        std::unique_lock lock{ mutex_ };
+        cv_.wait(lock, [this] { return queue_.size() < max_pending; });
+        queue_.push_back(std::move(block_));
+    }
+    cv_.notify_all();
+
+    block_ = Pending{};
+    block_.raw.reserve(block_header_size + block_size_ * max_record_size);
+}
+
+
+bool trace::Writer::finish() {
+    if (!thread_.joinable()) { return !failed_; }
+
+    submit();
+    {
+        std::scoped_lock lock{ mutex_ };
+        finishing_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+
+    // Index and trailer
+    const std::uint64_t index_offset{ written_ + buffer_.size() };
+    buffer_.insert(buffer_.end(), std::begin(index_magic), std::end(index_magic));
+    codec::put_varint(buffer_, index_.size());
+    for (const auto& info : index_) {
+        codec::put_varint(buffer_, info.offset);
+        codec::put_varint(buffer_, info.first_cycle);
+        codec::put_varint(buffer_, info.count);
+        codec::put_varint(buffer_, info.pc_pages);
+        codec::put_varint(buffer_, info.written_pages);
+        codec::put_varint(buffer_, info.opcode_groups);
+        codec::put_varint(buffer_, info.changed);
+    }
+    put_le(buffer_, index_offset);
+    flush();
+    file_.close();
+    if (file_.fail()) { failed_ = true; }
+    return !failed_;
+}
+
+
+void trace::Writer::write_loop() {
+    for (;;) {
+        Pending block{};
+        {
+            std::unique_lock lock{ mutex_ };
+            cv_.wait(lock, [this] { return !queue_.empty() || finishing_; });
+            if (queue_.empty()) { return; }
+            block = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        cv_.notify_all();
+        write_block(block);
+    }
+}
+
+
+void trace::Writer::write_block(Pending& block) {
+    compressed_.clear();
+    codec::compress(block.raw, compressed_);
+
+    block.info.offset = written_ + buffer_.size();
+    codec::put_varint(buffer_, block.info.first_cycle);
+    codec::put_varint(buffer_, block.info.count);
+    codec::put_varint(buffer_, block.raw.size());
+    codec::put_varint(buffer_, compressed_.size());
+    buffer_.insert(buffer_.end(), compressed_.begin(), compressed_.end());
+    index_.push_back(block.info);
+
+    if (buffer_.size() >= flush_threshold) { flush(); }
+}
+
+
+void trace::Writer::flush() {
+    file_.write(reinterpret_cast<const char*>(buffer_.data()),
+        static_cast<std::streamsize>(buffer_.size()));
+    file_.flush();
+    // Sticky, a full disk shouldn't go unnoticed until the index is missing
+    if (file_.fail()) { failed_ = true; }
+    written_ += buffer_.size();
+    buffer_.clear();
+}
+
+
+
+
+
+trace::Reader::Reader(const std::string& path) {
+    const int fd{ ::open(path.c_str(), O_RDONLY) };
+    if (fd < 0) {
+        throw std::runtime_error{
+            fmt::format("Unable to open trace {}: {}", path, std::strerror(errno))
+        };
+    }
+
+    struct stat st{};
+    void* mem{ MAP_FAILED };
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= header_size) {
+        mem = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+
+    if (mem == MAP_FAILED) {
+        throw std::runtime_error{ "Not a trace: " + path };
+    }
+    data_ = static_cast<const Byte*>(mem);
+    size_ = static_cast<size_t>(st.st_size);
+
+    if (std::memcmp(data_, magic, sizeof(magic)) != 0) {
+        munmap(mem, size_);
+        throw std::runtime_error{ "Not a trace: " + path };
+    }
+    const auto version = get_le<std::uint16_t>(data().subspan(4));
+    if (version != format_version) {
+        munmap(mem, size_);
+        throw std::runtime_error{ fmt::format("Unsupported trace version: {}", version) };
+    }
+    block_size_ = get_le<std::uint16_t>(data().subspan(6));
+
+    indexed_ = read_index();
+    if (!indexed_) {
+        scan();
+        decoded_ = 0;
+    }
+}
+
+
+trace::Reader::~Reader() {
+    munmap(const_cast<Byte*>(data_), size_);
+}
+
+
+bool trace::Reader::read_index() {
+    if (size_ < header_size + sizeof(index_magic) + trailer_size) { return false; }
+
+    const auto offset = get_le<std::uint64_t>(data().last(trailer_size));
+    if (offset < header_size || offset > size_ - trailer_size - sizeof(index_magic) ||
+        std::memcmp(data_ + offset, index_magic, sizeof(index_magic)) != 0)
+    {
+        return false;
+    }
+
+    size_t pos{ offset + sizeof(index_magic) };
+    const auto count = codec::get_varint(data(), pos);
+    if (!count || *count > offset) { return false; }
+
+    std::vector<BlockInfo> index;
+    index.reserve(*count);
+    for (std::uint64_t i{ 0 }; i < *count; ++i) {
+        std::array<std::uint64_t, 7> fields{};
+        for (auto& field : fields) {
+            const auto value = codec::get_varint(data(), pos);
+            if (!value) { return false; }
+            field = *value;
+        }
+        const BlockInfo info{
+            fields[0], fields[1], fields[2], fields[3], fields[4],
+            static_cast<std::uint16_t>(fields[5]), static_cast<std::uint32_t>(fields[6])
+        };
+        if (info.offset < header_size || info.offset >= offset ||
+            info.count == 0 || info.count > block_size_ ||
+            (!index.empty() && info.offset <= index.back().offset))
+        {
+            return false;
+        }
+        index.push_back(info);
+    }
+
+    blocks_ = std::move(index);
+    return true;
+}
+
+
+void trace::Reader::scan() {
+    blocks_.clear();
+
+    std::vector<Step> steps;
+    size_t pos{ header_size };
+    while (pos < size_) {
+        size_t next{ 0 };
+        try {
+            next = decode_at(pos, steps);
+        } catch (const std::runtime_error&) {
+            // Cut short or the index
+            break;
+        }
+        BlockInfo info{ pos, steps.front().cycle };
+        for (const auto& step : steps) { account(info, step); }
+        blocks_.push_back(info);
+        pos = next;
+    }
+}
+
+
+void trace::Reader::decode(size_t i, std::vector<Step>& out) const {
+    if (i >= blocks_.size()) {
+        throw std::runtime_error{ "Malformed trace" };
+    }
+    decode_at(blocks_[i].offset, out);
+    if (out.size() != blocks_[i].count || out.front().cycle != blocks_[i].first_cycle) {
+        throw std::runtime_error{ "Malformed trace" };
+    }
+}
+
+
+size_t trace::Reader::decode_at(size_t offset, std::vector<Step>& out) const {
+    const std::runtime_error malformed{ "Malformed trace" };
+
+    size_t pos{ offset };
+    const auto first_cycle = codec::get_varint(data(), pos);
+    const auto count = codec::get_varint(data(), pos);
+    const auto raw_size = codec::get_varint(data(), pos);
+    const auto compressed_size = codec::get_varint(data(), pos);
+    if (!first_cycle || !count || !raw_size || !compressed_size ||
+        *count == 0 || *count > block_size_ ||
+        *raw_size < block_header_size || *raw_size > block_header_size + *count * max_record_size ||
+        *compressed_size > size_ - pos)
+    {
+        throw malformed;
+    }
+
+    raw_.resize(*raw_size);
+    if (!codec::decompress(data().subspan(pos, *compressed_size), raw_)) {
+        throw malformed;
+    }
+    const std::span<const Byte> raw{ raw_ };
+
+    Step step{};
+    std::copy_n(raw.begin(), step.V.size(), step.V.begin());
+    step.I = get_le<Short>(raw.subspan(16));
+    Short next_pc{ get_le<Short>(raw.subspan(18)) };
+
+    out.clear();
+    size_t at{ block_header_size };
+    for (std::uint64_t i{ 0 }; i < *count; ++i) {
+        const auto delta = codec::get_varint(raw, at);
+        if (!delta || raw.size() - at < 2) { throw malformed; }
+        step.pc = static_cast<Short>(next_pc + codec::unzigzag(*delta));
+        step.opcode = static_cast<Short>(raw[at] << 8 | raw[at + 1]);
+        at += 2;
+
+        const auto changed = codec::get_varint(raw, at);
+        if (!changed || *changed >= changed_index << 1) { throw malformed; }
+        step.changed = static_cast<std::uint32_t>(*changed);
+
+        const auto [address, size] = implied_write(step.opcode, step.I);
+        step.write_address = address;
+        step.write_size = size;
+
+        for (size_t x{ 0 }; x < step.V.size(); ++x) {
+            if (!(step.changed & (1u << x))) { continue; }
+            if (at >= raw.size()) { throw malformed; }
+            step.V[x] = raw[at++];
+        }
+        if (step.changed & changed_index) {
+            const auto I = codec::get_varint(raw, at);
+            if (!I || *I > 0xFFFF) { throw malformed; }
+            step.I = static_cast<Short>(*I);
+        }
+
+        step.cycle = *first_cycle + i;
+        out.push_back(step);
+        next_pc = static_cast<Short>(step.pc + 2u);
+    }
+    if (at != raw.size()) { throw malformed; }
+
+    ++decoded_;
+    return pos + *compressed_size;
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include "Chip8.hpp"
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Instruction trace of a run (all integers little-endian):
+//
+//   Header: "C8TR", u16 version, u16 instructions per block
+//
+//   Blocks: varint cycle of the first instruction, varint instruction
+//   count, varint raw size, varint compressed size, then the raw block
+//   through codec::compress(). A raw block is V0..VF, u16 I and u16 pc
+//   before its first instruction, then per instruction:
+//   varint zig-zag pc delta from the previous pc + 2, u16 opcode
+//   big-endian as in memory, varint mask of the registers it changed
+//   (bit x for Vx, bit 16 for I) and the new values, a byte per Vx
+//   and a varint for I.
+//
+//   Index: "C8TI", varint block count, then per block varint offset,
+//   first cycle, count, pc pages, written pages, opcode groups and
+//   changed registers (see BlockInfo).
+//   Trailer: u64 offset of the index.
+//
+// Memory writes aren't stored, they follow from the opcode and I:
+// FX33 writes I..I+2 and FX55 I..I+X. Blocks decode independently,
+// so queries only decode the blocks their index entry doesn't rule out.
+// A trace cut short has no index, the reader then rebuilds it.
+namespace trace {
+
+constexpr std::uint16_t format_version{ 1 };
+
+// Changed register mask bit for I
+constexpr std::uint32_t changed_index{ 1u << 16 };
+
+
+struct BlockInfo {
+    // Of the block in the file
+    std::uint64_t offset{};
+    std::uint64_t first_cycle{};
+    std::uint64_t count{};
+    // Bit n set if an instruction in [64n, 64n + 64) ran
+    std::uint64_t pc_pages{};
+    // Same for memory written
+    std::uint64_t written_pages{};
+    // Bit n set if an opcode 0xnXXX ran
+    std::uint16_t opcode_groups{};
+    // Registers changed, as in the per instruction mask
+    std::uint32_t changed{};
+};
+
+// Page bits covering size bytes from address, wrapping at 4k
+std::uint64_t pages(Short address, size_t size) noexcept;
+
+
+// One decoded instruction
+struct Step {
+    // Instructions executed before it
+    std::uint64_t cycle{};
+    Short pc{};
+    Short opcode{};
+    // Registers after it
+    std::array<Byte, 16> V{};
+    Short I{};
+    std::uint32_t changed{};
+    // Memory it wrote, FX33 and FX55
+    Short write_address{};
+    Byte write_size{};
+
+    bool wrote(Short address) const noexcept {
+        return static_cast<Short>(address - write_address) % Chip8Base::memory_size < write_size;
+    }
+};
+
+
+
+// Records every instruction of a run.
+//
+// The emulation thread only appends a few varints per instruction,
+// full blocks are compressed and written on a background thread.
+// Nothing is ever dropped, record() waits if the writer falls behind.
+class Writer {
+private:
+    struct Pending {
+        BlockInfo info;
+        std::vector<Byte> raw;
+    };
+    static constexpr size_t max_pending{ 16 };
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Pending> queue_;
+    bool finishing_{ false };
+    std::thread thread_;
+
+    // Emulation thread only
+    std::uint16_t block_size_;
+    Pending block_{};
+    std::array<Byte, 16> V_{};
+    Short I_{ 0 };
+    Short next_pc_{ 0 };
+    std::uint64_t next_cycle_{ 0 };
+
+    // Writer thread only
+    std::ofstream file_;
+    std::vector<Byte> buffer_;
+    std::vector<Byte> compressed_;
+    std::uint64_t written_{ 0 };
+    std::vector<BlockInfo> index_;
+    // Set by the writer thread, read once it's joined
+    bool failed_{ false };
+
+public:
+    // Throws std::runtime_error if the file can't be created
+    explicit Writer(const std::string& path, std::uint16_t block_size = 4096);
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    // Calls finish()
+    ~Writer();
+
+    // Take the registers and cycle count of c8 as they are now,
+    // call whenever its state was replaced
+    void sync(const Chip8& c8);
+
+    // After the instruction at pc ran on c8. Does nothing if no
+    // instruction ran since the last call.
+    void record(Short pc, const Chip8& c8);
+
+    // Write out pending blocks and the index. Further records are ignored.
+    // Returns false if writing the file failed at any point, the trace
+    // is then cut short.
+    bool finish();
+
+private:
+    void submit();
+    void write_loop();
+    void write_block(Pending& block);
+    void flush();
+};
+
+
+
+// Memory-mapped trace
+class Reader {
+private:
+    const Byte* data_{ nullptr };
+    size_t size_{ 0 };
+    std::uint16_t block_size_{};
+    std::vector<BlockInfo> blocks_;
+    bool indexed_{ false };
+
+    mutable std::vector<Byte> raw_;
+    mutable std::uint64_t decoded_{ 0 };
+
+public:
+    // Throws std::runtime_error on a missing file or bad header
+    explicit Reader(const std::string& path);
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    ~Reader();
+
+    const std::vector<BlockInfo>& blocks() const noexcept { return blocks_; }
+    std::uint16_t block_size() const noexcept { return block_size_; }
+    size_t file_size() const noexcept { return size_; }
+
+    // False if the index was missing and rebuilt by decoding everything
+    bool indexed() const noexcept { return indexed_; }
+
+    // Blocks decode() decoded so far
+    std::uint64_t decoded() const noexcept { return decoded_; }
+
+    // Replaces out with the instructions of block i.
+    // Throws std::runtime_error on a malformed block.
+    void decode(size_t i, std::vector<Step>& out) const;
+
+private:
+    std::span<const Byte> data() const noexcept { return { data_, size_ }; }
+    bool read_index();
+    void scan();
+    // Decodes the block at offset, returns where the next one starts
+    size_t decode_at(size_t offset, std::vector<Step>& out) const;
+};
+
+
+} // namespace trace
@@ -0,0 +1,221 @@
+#include "VecEnv.hpp"
+#include "Parse.hpp"
+#include <fmt/format.h>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+
+namespace {
+
+// splitmix64, decorrelates per-instance seeds
+std::uint64_t mix_seed(std::uint64_t x) noexcept {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Checked before narrowing, a huge value mustn't wrap around
+unsigned get_unsigned(const RomConfig& rom_config, std::string_view key, unsigned fallback) {
+    const auto value = rom_config.get_uint(key, fallback);
+    if (value > std::numeric_limits<unsigned>::max()) {
+        throw std::runtime_error{
+            fmt::format("{}: '{}' is out of range: {}", rom_config.path(), key, value)
+        };
+    }
+    return static_cast<unsigned>(value);
+}
+
+} // namespace
+
+
+
+
+VecEnv::Config VecEnv::config_from(const RomConfig& rom_config, Config base) {
+
+    base.frames_per_step = get_unsigned(rom_config, "frames_per_step", base.frames_per_step);
+    base.cycles_per_frame = get_unsigned(rom_config, "cycles_per_frame", base.cycles_per_frame);
+    base.max_episode_frames =
+        rom_config.get_uint("max_episode_frames", base.max_episode_frames);
+    base.seed = rom_config.get_uint("seed", base.seed);
+
+    try {
+        if (auto mode = rom_config.get("timing")) {
+            if (*mode != "fixed" && *mode != "vip") {
+                throw std::invalid_argument{ fmt::format("unknown timing '{}'", *mode) };
+            }
+            base.vip_timing = *mode == "vip";
+        }
+
+        if (auto spec = rom_config.get("score")) {
+            base.hooks.score = [probe = Probe::parse(*spec)](const Chip8& c8) {
+                return static_cast<double>(probe.read(c8));
+            };
+        }
+
+        if (auto spec = rom_config.get("done")) {
+            const bool equal{ spec->find("==") != std::string_view::npos };
+            const auto op = spec->find(equal ? "==" : "!=");
+            if (op == std::string_view::npos) {
+                throw std::invalid_argument{ "expected '<probe> == <value>' or '!='" };
+            }
+            const auto probe = Probe::parse(spec->substr(0, op));
+            const auto value = text::parse_uint(spec->substr(op + 2));
+
+            base.hooks.done = [probe, value, equal](const Chip8& c8) {
+                return (probe.read(c8) == value) == equal;
+            };
+        }
+    } catch (const std::logic_error& e) {
+        throw std::runtime_error{ fmt::format("{}: {}", rom_config.path(), e.what()) };
+    }
+
+    return base;
+}
+
+
+
+
+
+VecEnv::VecEnv(
+    std::span<const Byte> rom,
+    const Config& config,
+    std::span<Byte> observations
+) :
+    config_{ config },
+    observations_{ observations },
+    pool_{ config.threads > 1 ? config.threads - 1 : 0 }
+{
+    if (observations.size() != config.num_envs * obs_size(config.obs_format)) {
+        throw std::invalid_argument{ "Observation buffer has the wrong size" };
+    }
+
+    baseline_.load_program(rom);
+    baseline_.mark_baseline();
+
+    envs_.resize(config.num_envs, Instance{ baseline_ });
+    reset();
+}
+
+
+
+void VecEnv::reset(std::span<const Byte> mask) {
+    if (!mask.empty() && mask.size() != envs_.size()) {
+        throw std::invalid_argument{ "Reset mask has the wrong size" };
+    }
+
+    pool_.parallel_for(envs_.size(), 16, [&](size_t begin, size_t end) {
+        for (size_t i{ begin }; i < end; ++i) {
+            if (mask.empty() || mask[i]) { reset_one(i); }
+        }
+    });
+}
+
+
+void VecEnv::reset_one(size_t i) {
+    Instance& env = envs_[i];
+
+    env.chip8.reset_to(baseline_);
+    env.clock = {};
+    env.chip8.seed(mix_seed(config_.seed ^ mix_seed(i) ^ (env.episode << 32)));
+    ++env.episode;
+
+    env.held_key = -1;
+    env.frames = 0;
+    env.done = false;
+    env.score = config_.hooks.score ? config_.hooks.score(env.chip8) : 0.0;
+
+    write_observation(i);
+}
+
+
+
+void VecEnv::step(
+    std::span<const int> actions,
+    std::span<double> rewards,
+    std::span<Byte> dones
+) {
+    if (actions.size() != envs_.size() ||
+        rewards.size() != envs_.size() ||
+        dones.size() != envs_.size())
+    {
+        throw std::invalid_argument{ "Step buffers have the wrong size" };
+    }
+
+    const Hooks& hooks = config_.hooks;
+
+    pool_.parallel_for(envs_.size(), 4, [&](size_t begin, size_t end) {
+        for (size_t i{ begin }; i < end; ++i) {
+            Instance& env = envs_[i];
+            Chip8& c8 = env.chip8;
+
+            if (env.done) {
+                rewards[i] = 0.0;
+                dones[i] = 1;
+                continue;
+            }
+
+            const int action{ actions[i] };
+            if (action != env.held_key) {
+                if (env.held_key >= 0) { c8.key_release(static_cast<Byte>(env.held_key)); }
+                if (action >= 0) { c8.key_press(static_cast<Byte>(action & 0xF)); }
+                env.held_key = action >= 0 ? (action & 0xF) : -1;
+            }
+
+            for (unsigned frame{ 0 }; frame < config_.frames_per_step; ++frame) {
+                if (config_.vip_timing) {
+                    env.clock.run_frame(c8);
+                } else {
+                    for (unsigned cycle{ 0 }; cycle < config_.cycles_per_frame; ++cycle) {
+                        c8.emulate_cycle();
+                    }
+                    c8.update_timers();
+                }
+                ++env.frames;
+            }
+            c8.reset_draw_flag();
+
+            if (hooks.score) {
+                const double score{ hooks.score(c8) };
+                rewards[i] = score - env.score;
+                env.score = score;
+            } else {
+                rewards[i] = 0.0;
+            }
+
+            // A faulted interpreter can't make progress
+            env.done =
+                c8.get_fault() != Chip8::Fault::none ||
+                (hooks.done && hooks.done(c8)) ||
+                (config_.max_episode_frames && env.frames >= config_.max_episode_frames);
+            dones[i] = env.done;
+
+            write_observation(i);
+        }
+    });
+}
+
+
+
+void VecEnv::write_observation(size_t i) noexcept {
+    const auto& fb = envs_[i].chip8.framebuffer();
+    const size_t size{ obs_size(config_.obs_format) };
+    Byte* out = observations_.data() + i * size;
+
+    if (config_.obs_format == ObsFormat::bits) {
+        // Rows are already packed, leftmost pixel in the MSB
+        for (std::uint64_t row : fb) {
+            for (size_t shift{ Chip8Base::fb_width }; shift != 0; shift -= 8) {
+                *out++ = static_cast<Byte>(row >> (shift - 8));
+            }
+        }
+        return;
+    }
+
+    for (std::uint64_t row : fb) {
+        for (size_t x{ 0 }; x < Chip8Base::fb_width; ++x) {
+            *out++ = static_cast<Byte>((row >> (Chip8Base::fb_width - 1 - x)) & 1u);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "Chip8.hpp"
+#include "Probe.hpp"
+#include "RomConfig.hpp"
+#include "ThreadPool.hpp"
+#include "Timing.hpp"
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+
+// Vectorized environment over many Chip8 instances of one ROM.
+//
+// Observations are framebuffers written straight into a
+// caller-owned [N x 32 x 64] tensor, either one byte per pixel
+// or packed 8 pixels per byte, MSB first ([N x 32 x 8]).
+// Instances are reset through dirty tracking from a shared
+// baseline, and stepped in parallel on a work-stealing thread pool.
+class VecEnv {
+public:
+    enum class ObsFormat { bytes, bits };
+
+    // Per-instance reward and episode end.
+    // Reward per step is score(after) - score(before).
+    struct Hooks {
+        std::function<double(const Chip8&)> score;
+        std::function<bool(const Chip8&)> done;
+    };
+
+    struct Config {
+        size_t num_envs{ 1 };
+        unsigned frames_per_step{ 4 };
+        unsigned cycles_per_frame{ 10 };
+        // COSMAC VIP instruction timing, cycles_per_frame is then unused
+        bool vip_timing{ false };
+        // Episode is cut off after this many frames, 0 is unlimited
+        std::uint64_t max_episode_frames{ 0 };
+        std::uint64_t seed{ Rng::default_seed };
+        ObsFormat obs_format{ ObsFormat::bytes };
+        size_t threads{ std::thread::hardware_concurrency() };
+        Hooks hooks{};
+    };
+
+    // Overrides base with frames_per_step, cycles_per_frame, timing ("fixed" or "vip"),
+    // max_episode_frames, seed
+    // and the probes "score" (a Probe spec) and "done" ("<probe> == <value>").
+    // Throws std::runtime_error on malformed values.
+    static Config config_from(const RomConfig& rom_config, Config base);
+
+    static constexpr size_t obs_size(ObsFormat format) noexcept {
+        return format == ObsFormat::bytes ?
+            Chip8Base::fb_width * Chip8Base::fb_height :
+            Chip8Base::fb_width * Chip8Base::fb_height / 8;
+    }
+
+private:
+    struct Instance {
+        Chip8 chip8;
+        timing::Clock clock{};
+        int held_key{ -1 };
+        double score{ 0.0 };
+        std::uint64_t frames{ 0 };
+        std::uint64_t episode{ 0 };
+        bool done{ false };
+    };
+
+    Config config_;
+    Chip8 baseline_;
+    std::vector<Instance> envs_;
+    std::span<Byte> observations_;
+    ThreadPool pool_;
+
+public:
+    // observations must hold num_envs * obs_size(obs_format) bytes.
+    // Throws std::invalid_argument otherwise.
+    VecEnv(std::span<const Byte> rom, const Config& config, std::span<Byte> observations);
+
+    // Reset instances whose mask entry is non-zero, all if mask is empty.
+    // Writes their observations. Throws std::invalid_argument if mask
+    // is neither empty nor num_envs entries.
+    void reset(std::span<const Byte> mask = {});
+
+    // Action per instance: key to hold for the step (0x0-0xF),
+    // or -1 for none. Instances that are done are left untouched
+    // until reset. rewards and dones must hold num_envs entries.
+    void step(
+        std::span<const int> actions,
+        std::span<double> rewards,
+        std::span<Byte> dones
+    );
+
+    size_t size() const noexcept { return envs_.size(); }
+    const Chip8& instance(size_t i) const noexcept { return envs_[i].chip8; }
+    const Config& config() const noexcept { return config_; }
+
+    // Per-thread utilization and steal counts of reset() and step()
+    const ThreadPool& pool() const noexcept { return pool_; }
+
+private:
+    void reset_one(size_t i);
+    void write_observation(size_t i) noexcept;
+};
@@ -0,0 +1,201 @@
+#pragma once
+#include "Chip8.hpp"
+#include <SFML/Config.hpp>
+#include <SFML/Graphics.hpp>
+#include <SFML/Window/Event.hpp>
+#include <SFML/Window/Keyboard.hpp>
+#include <SFML/Window/VideoMode.hpp>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+
+// Grid of many instances in one window.
+//
+// Every instance has a tile in one atlas texture, and the wall
+// is a single vertex array of textured quads, so presenting it is
+// one draw call however many instances there are. Tiles are only
+// re-uploaded when their instance's frame changed.
+class Wall {
+private:
+    static constexpr unsigned tile_width{ Chip8Base::fb_width };
+    static constexpr unsigned tile_height{ Chip8Base::fb_height };
+    // Between tiles, in screen pixels
+    static constexpr float gap{ 2.f };
+
+    sf::RenderWindow window_;
+    size_t count_;
+    unsigned columns_{ 1 };
+    unsigned rows_{ 1 };
+
+    sf::Texture atlas_;
+    sf::VertexArray quads_{ sf::Quads };
+
+    // Last frame uploaded per tile
+    std::vector<Chip8::framebuffer_t> frames_;
+    std::vector<size_t> dirty_;
+    std::vector<Byte> is_dirty_;
+    size_t uploaded_{ 0 };
+
+    using tile_buffer_t = std::array<sf::Uint8, tile_width * tile_height * 4>;
+    tile_buffer_t tile_buffer_{};
+
+public:
+    // Throws std::runtime_error if the atlas would exceed
+    // the largest texture the GPU supports.
+    explicit Wall(size_t count, unsigned width = 1280, unsigned height = 720) :
+        window_{ sf::VideoMode{ width, height }, "Chip8 Wall" },
+        count_{ count ? count : 1 },
+        frames_(count_),
+        is_dirty_(count_, 0)
+    {
+        window_.setKeyRepeatEnabled(false);
+        choose_grid(width, height);
+
+        const unsigned max_size{ sf::Texture::getMaximumSize() };
+        if (columns_ * tile_width > max_size || rows_ * tile_height > max_size ||
+            !atlas_.create(columns_ * tile_width, rows_ * tile_height))
+        {
+            throw std::runtime_error{ "Too many instances for one texture" };
+        }
+
+        // Start out blank
+        for (size_t i{ 0 }; i < count_; ++i) { upload(i); }
+        layout(width, height);
+    }
+
+
+    bool is_open() const { return window_.isOpen(); }
+    void close() { window_.close(); }
+
+    size_t size() const noexcept { return count_; }
+
+    // Tiles uploaded by the last present()
+    size_t uploaded() const noexcept { return uploaded_; }
+
+
+    void process_events() {
+        sf::Event event;
+        while (window_.pollEvent(event)) {
+            switch (event.type) {
+                case sf::Event::Closed:
+                    window_.close();
+                    break;
+                case sf::Event::Resized:
+                    window_.setView(sf::View{ sf::FloatRect{
+                        0.f, 0.f,
+                        static_cast<float>(event.size.width),
+                        static_cast<float>(event.size.height)
+                    } });
+                    layout(event.size.width, event.size.height);
+                    break;
+                case sf::Event::KeyPressed:
+                    if (event.key.code == sf::Keyboard::Key::Escape) { window_.close(); }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+
+    // Take in instance i's frame, uploaded on the next present() if it changed
+    void update(size_t i, const Chip8::framebuffer_t& fb) {
+        if (i >= count_ || frames_[i] == fb) { return; }
+        frames_[i] = fb;
+        if (!is_dirty_[i]) {
+            is_dirty_[i] = 1;
+            dirty_.push_back(i);
+        }
+    }
+
+
+    // Upload changed tiles and draw the wall
+    void present() {
+        uploaded_ = dirty_.size();
+        for (size_t i : dirty_) {
+            upload(i);
+            is_dirty_[i] = 0;
+        }
+        dirty_.clear();
+
+        sf::RenderStates states{};
+        states.texture = &atlas_;
+        window_.clear(sf::Color{ 0u, 0u, 0u });
+        window_.draw(quads_, states);
+        window_.display();
+    }
+
+private:
+    // Columns that make the tiles largest in the window
+    void choose_grid(unsigned width, unsigned height) {
+        float best{ std::numeric_limits<float>::lowest() };
+        for (unsigned columns{ 1 }; columns <= count_; ++columns) {
+            const unsigned rows{ static_cast<unsigned>((count_ + columns - 1) / columns) };
+            const float scale{ std::min(
+                (width - gap * (columns - 1)) / (columns * tile_width),
+                (height - gap * (rows - 1)) / (rows * tile_height)
+            ) };
+            if (scale > best) {
+                best = scale;
+                columns_ = columns;
+                rows_ = rows;
+            }
+        }
+    }
+
+    // Place the quads for a window size, texture coordinates stay put
+    void layout(unsigned width, unsigned height) {
+        const float scale{ std::max(0.f, std::min(
+            (width - gap * (columns_ - 1)) / (columns_ * tile_width),
+            (height - gap * (rows_ - 1)) / (rows_ * tile_height)
+        )) };
+        const float w{ tile_width * scale };
+        const float h{ tile_height * scale };
+
+        quads_.resize(count_ * 4);
+        for (size_t i{ 0 }; i < count_; ++i) {
+            const unsigned column{ static_cast<unsigned>(i % columns_) };
+            const unsigned row{ static_cast<unsigned>(i / columns_) };
+            const float x{ column * (w + gap) };
+            const float y{ row * (h + gap) };
+            const float u{ static_cast<float>(column * tile_width) };
+            const float v{ static_cast<float>(row * tile_height) };
+
+            sf::Vertex* quad{ &quads_[i * 4] };
+            quad[0].position = { x, y };
+            quad[1].position = { x + w, y };
+            quad[2].position = { x + w, y + h };
+            quad[3].position = { x, y + h };
+            quad[0].texCoords = { u, v };
+            quad[1].texCoords = { u + tile_width, v };
+            quad[2].texCoords = { u + tile_width, v + tile_height };
+            quad[3].texCoords = { u, v + tile_height };
+        }
+    }
+
+    void upload(size_t i) {
+        // Same colors as Canvas, Solarized Dark
+        const sf::Color bg{ 0x00, 0x2B, 0x36 };
+        const sf::Color fg{ 0x83, 0x94, 0x96 };
+
+        const auto& fb = frames_[i];
+        size_t j{ 0 };
+        for (size_t y{ 0 }; y < tile_height; ++y) {
+            for (size_t x{ 0 }; x < tile_width; ++x) {
+                const sf::Color& c{ Chip8::pixel(fb, x, y) ? fg : bg };
+                tile_buffer_[j++] = c.r;
+                tile_buffer_[j++] = c.g;
+                tile_buffer_[j++] = c.b;
+                tile_buffer_[j++] = 0xFF;
+            }
+        }
+        atlas_.update(
+            tile_buffer_.data(), tile_width, tile_height,
+            static_cast<unsigned>(i % columns_) * tile_width,
+            static_cast<unsigned>(i / columns_) * tile_height
+        );
+    }
+};
@@ -1,16 +1,31 @@
-#include "Canvas.hpp"
+#include "Audio.hpp"
 #include "Chip8.hpp"
 #include "Debug.hpp"
+#include "Debugger.hpp"
+#include "Display.hpp"
+#include "FrameStream.hpp"
+#include "Metrics.hpp"
+#include "Recording.hpp"
+#include "Rewind.hpp"
+#include "RomConfig.hpp"
+#include "Snapshot.hpp"
+#include "Spectator.hpp"
+#include "Timing.hpp"
+#include "Trace.hpp"
+#include "VecEnv.hpp"
+#include "Wall.hpp"
 #include <fmt/format.h>
 #include <chrono>
 #include <ios>
 #include <iterator>
 #include <thread>
 #include <cassert>
+#include <csignal>
 #include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <optional>
+#include <stdexcept>
 #include <vector>
 #include <string>
 #include <string_view>
@@ -38,55 +53,611 @@ static std::optional<std::vector<Byte>> read_binary(const std::string& file) {
 }
 
 
+// Frames between state hashes in recordings
+constexpr size_t hash_interval{ 60 };
+
+constexpr unsigned max_run_ahead{ 8 };
+
+
+struct Options {
+    std::string file;
+    std::string audio{ "sfml" };
+    std::string record;
+    std::string replay;
+    std::uint64_t seed{ Rng::default_seed };
+    std::optional<std::uint64_t> run_ahead{};
+    std::optional<std::string> timing{};
+    std::string metrics;
+    std::string display{ "sfml" };
+    std::string capture;
+    std::string spectate;
+    std::string trace_file;
+    std::uint64_t frames{ 0 };
+    size_t wall{ 0 };
+    bool uncapped{ false };
+    bool debug{ false };
+    bool trace{ false };
+};
+
+static constexpr std::string_view usage{
+    "Usage:\n"
+    "    chip8 [options] [file]\n"
+    "Options:\n"
+    "    --audio=<sink>    sfml (default), null or wav:<path>\n"
+    "    --display=<name>  sfml (default), null or shm:<name> to publish\n"
+    "                      frames into a POSIX shared memory ring\n"
+    "    --capture=<path>  Record presented frames to a compressed stream,\n"
+    "                      see chip8-frames to export them\n"
+    "    --spectate=<spec> Stream frames to local viewers on tcp:<port>\n"
+    "                      or unix:<path>\n"
+    "    --frames=<n>      Quit after n frames\n"
+    "    --wall=<n>        Watch n instances with random input side by side\n"
+    "    --uncapped        Run as fast as possible instead of at 60 fps\n"
+    "    --debug           Start paused in the console debugger,\n"
+    "                      'h' at its prompt lists the commands\n"
+    "    --trace           Print every instruction and the registers\n"
+    "    --trace-file=<path>\n"
+    "                      Record every instruction to an indexed trace,\n"
+    "                      see chip8-trace to query it\n"
+    "    --seed=<n>        Seed the random number generator\n"
+    "    --record=<path>   Record input for deterministic replay\n"
+    "    --replay=<path>   Replay a recording headlessly, as fast as possible\n"
+    "    --run-ahead=<n>   Present frames n frames ahead to hide input lag,\n"
+    "                      overrides 'run_ahead' in [file].cfg\n"
+    "    --timing=<mode>   fixed (default), 10 instructions per frame, or vip,\n"
+    "                      COSMAC VIP instruction timing with display wait,\n"
+    "                      overrides 'timing' in [file].cfg\n"
+    "    --metrics=<spec>  Export metrics as Prometheus text,\n"
+    "                      http:<port> on localhost or file:<path> every second\n"
+    "Keys:\n"
+    "    F5 / F9           Quick save / load to [file].state\n"
+    "    Backspace (hold)  Rewind\n"
+    "Quick load and rewind are disabled while recording.\n"
+};
+
+
+static std::optional<Options> parse_args(int argc, const char* argv[]) {
+    Options opts{};
+
+    for (int i{ 1 }; i < argc; ++i) {
+        std::string_view arg{ argv[i] };
+
+        if (arg.starts_with("--audio=")) {
+            opts.audio = arg.substr(8);
+        } else if (arg.starts_with("--record=")) {
+            opts.record = arg.substr(9);
+        } else if (arg.starts_with("--replay=")) {
+            opts.replay = arg.substr(9);
+        } else if (arg.starts_with("--run-ahead=")) {
+            try {
+                opts.run_ahead = std::stoull(std::string{ arg.substr(12) });
+            } catch (const std::exception&) {
+                std::cerr << "Invalid run-ahead: " << arg.substr(12) << '\n';
+                return {};
+            }
+        } else if (arg.starts_with("--display=")) {
+            opts.display = arg.substr(10);
+        } else if (arg.starts_with("--capture=")) {
+            opts.capture = arg.substr(10);
+        } else if (arg.starts_with("--spectate=")) {
+            opts.spectate = arg.substr(11);
+        } else if (arg.starts_with("--frames=")) {
+            try {
+                opts.frames = std::stoull(std::string{ arg.substr(9) });
+            } catch (const std::exception&) {
+                std::cerr << "Invalid frame count: " << arg.substr(9) << '\n';
+                return {};
+            }
+        } else if (arg.starts_with("--wall=")) {
+            try {
+                opts.wall = std::stoul(std::string{ arg.substr(7) });
+            } catch (const std::exception&) {
+                std::cerr << "Invalid instance count: " << arg.substr(7) << '\n';
+                return {};
+            }
+        } else if (arg == "--uncapped") {
+            opts.uncapped = true;
+        } else if (arg == "--debug") {
+            opts.debug = true;
+        } else if (arg == "--trace") {
+            opts.trace = true;
+        } else if (arg.starts_with("--trace-file=")) {
+            opts.trace_file = arg.substr(13);
+        } else if (arg.starts_with("--metrics=")) {
+            opts.metrics = arg.substr(10);
+        } else if (arg.starts_with("--timing=")) {
+            opts.timing = arg.substr(9);
+        } else if (arg.starts_with("--seed=")) {
+            try {
+                opts.seed = std::stoull(std::string{ arg.substr(7) }, nullptr, 0);
+            } catch (const std::exception&) {
+                std::cerr << "Invalid seed: " << arg.substr(7) << '\n';
+                return {};
+            }
+        } else if (arg.starts_with("--")) {
+            std::cerr << "Unknown option: " << arg << '\n';
+            return {};
+        } else {
+            opts.file = arg;
+        }
+    }
+
+    if (opts.file.empty()) { return {}; }
+    return opts;
+}
+
+
+// Lets headless displays shut down cleanly
+static volatile std::sig_atomic_t interrupted{ 0 };
+
+static void on_interrupt(int) {
+    interrupted = 1;
+}
+
+
+static int run_replay(const Options& opts, const std::vector<Byte>& program) {
+    try {
+        auto result = recording::replay(opts.replay, program);
+
+        const double seconds{
+            std::chrono::duration<double>(result.elapsed).count()
+        };
+        fmt::print(
+            "Replayed {} frames, {} cycles in {:.3f}s ({:.2f} Mcycles/s)\n"
+            "Checked {} state hashes, final state hash {:016x}\n",
+            result.frames, result.cycles, seconds,
+            seconds > 0 ? result.cycles / seconds / 1e6 : 0.0,
+            result.hashes_checked, result.final_hash
+        );
+
+        if (result.desync_cycle) {
+            fmt::print(stderr, "Desync detected at cycle {}\n", *result.desync_cycle);
+            return 2;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << opts.replay << ": " << e.what() << '\n';
+        return 1;
+    }
+}
+
+
+
+// Batch of instances stepped in parallel, each holding random keys
+static int run_wall(const Options& opts, const std::vector<Byte>& program) {
+    try {
+        VecEnv::Config config{};
+        config.num_envs = opts.wall;
+        config.seed = opts.seed;
+        config = VecEnv::config_from(RomConfig::load_for(opts.file), config);
+        if (opts.timing) {
+            if (*opts.timing != "fixed" && *opts.timing != "vip") {
+                throw std::runtime_error{ "Unknown timing mode: " + *opts.timing };
+            }
+            config.vip_timing = *opts.timing == "vip";
+        }
+        // One step per presented frame
+        config.frames_per_step = 1;
+        config.obs_format = VecEnv::ObsFormat::bits;
+
+        std::vector<Byte> observations(config.num_envs * VecEnv::obs_size(config.obs_format));
+        VecEnv env{ program, config, observations };
+        Wall wall{ env.size() };
+
+        std::vector<int> actions(env.size(), -1);
+        std::vector<double> rewards(env.size());
+        std::vector<Byte> dones(env.size());
+        Rng rng{};
+        rng.seed(opts.seed);
+
+        env.reset();
+        for (std::uint64_t frame_count{ 0 }; wall.is_open() && !interrupted; ) {
+            const auto frame_start = std::chrono::steady_clock::now();
+            auto next_frame =
+                std::chrono::time_point_cast<frame>(frame_start) + frame{ 1 };
+            wall.process_events();
+
+            // Change keys about every half second
+            for (int& action : actions) {
+                if (rng.next_byte() < 8) {
+                    const Byte roll{ rng.next_byte() };
+                    action = roll < 0x80 ? roll & 0xF : -1;
+                }
+            }
+            env.step(actions, rewards, dones);
+
+            for (size_t i{ 0 }; i < env.size(); ++i) {
+                wall.update(i, env.instance(i).framebuffer());
+            }
+            wall.present();
+
+            if (std::find(dones.begin(), dones.end(), 1) != dones.end()) {
+                env.reset(dones);
+            }
+
+            if (opts.frames && ++frame_count >= opts.frames) { break; }
+            if (!opts.uncapped) {
+                std::this_thread::sleep_until(next_frame);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+
 
 int main(int argc, const char* argv[]) {
 
-    // Argument parser would be nice, maybe...
-    if (argc < 2) {
-        std::cout << "Usage:\n    chip8 [file]\n";
+    auto opts = parse_args(argc, argv);
+    if (!opts.has_value()) {
+        std::cout << usage;
         return 0;
     }
 
-    std::string file{ argv[1] };
+    const std::string& file{ opts->file };
     auto program = read_binary(file);
     if (!program.has_value()) {
         std::cerr << "Unable to open file: " << file << '\n';
         return 1;
     }
 
+    if (!opts->replay.empty()) {
+        return run_replay(*opts, program.value());
+    }
+
+    std::signal(SIGINT, on_interrupt);
+
+    if (opts->wall) {
+        return run_wall(*opts, program.value());
+    }
+
+    std::uint64_t run_ahead_frames{ 0 };
+    std::string timing_mode{ "fixed" };
+    try {
+        auto config = RomConfig::load_for(file);
+        run_ahead_frames = opts->run_ahead.value_or(config.get_uint("run_ahead", 0));
+        timing_mode = opts->timing.value_or(
+            std::string{ config.get("timing").value_or(timing_mode) }
+        );
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    if (timing_mode != "fixed" && timing_mode != "vip") {
+        std::cerr << "Unknown timing mode: " << timing_mode << '\n';
+        return 1;
+    }
+    // Checked before narrowing, so a huge value can't wrap around into range
+    if (run_ahead_frames > max_run_ahead) {
+        std::cerr << "Run-ahead is limited to " << max_run_ahead << " frames\n";
+        return 1;
+    }
+    unsigned run_ahead{ static_cast<unsigned>(run_ahead_frames) };
+    if (opts->debug) {
+        // The frames run ahead would pass breakpoints unnoticed
+        run_ahead = 0;
+    }
+
+    std::optional<Audio> audio{};
+    try {
+        audio.emplace(make_audio_sink(opts->audio));
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    metrics::Registry registry{};
+    metrics::Frontend stats{ registry };
+    std::unique_ptr<metrics::Exporter> exporter{};
+    if (!opts->metrics.empty()) {
+        try {
+            exporter = metrics::make_exporter(registry, opts->metrics);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
 
-    Canvas canvas{};
-    auto& window = canvas.window();
+    std::unique_ptr<Display> display{};
+    try {
+        display = make_display(opts->display);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    display->set_metrics(&stats);
 
     Chip8 chip8{};
+    chip8.seed(opts->seed);
     chip8.load_program(program.value());
+    chip8.set_buzzer_queue(&audio->queue());
 
-    while (window.isOpen()) {
+    // Emulated time for VIP timing, fixed timing counts instructions
+    std::optional<timing::Clock> clock{};
+    if (timing_mode == "vip") {
+        clock.emplace();
+    }
+
+    std::optional<recording::Recorder> recorder{};
+    if (!opts->record.empty()) {
+        try {
+            recorder.emplace(opts->record, recording::Header{
+                .cycles_per_frame = static_cast<std::uint16_t>(clock ? 0 : cycles_per_frame),
+                .rom_hash = recording::rom_hash(program.value()),
+                .seed = opts->seed
+            });
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        display->set_recorder(&recorder.value());
+    }
+    size_t frame_count{ 0 };
+    bool halted{ false };
+
+    std::optional<framestream::Recorder> capture{};
+    if (!opts->capture.empty()) {
+        try {
+            capture.emplace(opts->capture);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    std::optional<spectator::Server> spectators{};
+    if (!opts->spectate.empty()) {
+        try {
+            spectators.emplace(opts->spectate);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    auto present = [&](const Chip8::framebuffer_t& fb) {
+        display->update(fb);
+        display->redraw();
+        if (capture) { capture->push(fb, frame_count); }
+        if (spectators) { spectators->publish(fb); }
+    };
+
+    RewindBuffer rewind{};
+    Snapshot state{};
+    const std::string state_file{ file + ".state" };
+
+    // Instructions per second are averaged over this window
+    auto rate_start = std::chrono::steady_clock::now();
+    std::uint64_t rate_instructions{ 0 };
+
+    auto count_sprite = [&] {
+        if ((chip8.get_opcode() & 0xF000) == 0xD000) { stats.sprite_draws.add(); }
+    };
+
+    std::optional<trace::Writer> tracer{};
+    if (!opts->trace_file.empty()) {
+        try {
+            tracer.emplace(opts->trace_file);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        tracer->sync(chip8);
+    }
+
+    std::optional<Debugger> debugger{};
+    if (opts->debug) { debugger.emplace(true); }
+
+    // Hands over to the debugger before the next instruction if it
+    // asks for it, true if the user quit from there
+    auto debugger_quit = [&] {
+        return debugger && debugger->should_stop(chip8) && !debugger->prompt(chip8, std::cin);
+    };
+    bool quit{ false };
+
+    while (display->is_open() && !interrupted) {
+        const auto frame_start = std::chrono::steady_clock::now();
         auto next_frame =
-            std::chrono::time_point_cast<frame>(std::chrono::steady_clock::now())
-            + frame{ 1 };
+            std::chrono::time_point_cast<frame>(frame_start) + frame{ 1 };
+
+        auto& hotkeys = display->hotkeys();
+
+        if (recorder) {
+            // Both would break determinism of the recording
+            hotkeys.quick_load = false;
+            hotkeys.rewind = false;
+        }
+
+        if (hotkeys.quick_save) {
+            hotkeys.quick_save = false;
+            std::ofstream fs{ state_file, std::ios_base::binary };
+            try {
+                snapshot::write(fs, chip8.snapshot());
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << '\n';
+            }
+        }
+
+        if (hotkeys.quick_load) {
+            hotkeys.quick_load = false;
+            std::ifstream fs{ state_file, std::ios_base::binary };
+            try {
+                chip8.load_state(snapshot::read(fs));
+                // The state is saved between frames, start a new one
+                if (clock) { clock.emplace(); }
+                if (tracer) { tracer->sync(chip8); }
+                rewind.clear();
+                present(chip8.framebuffer());
+            } catch (const std::exception& e) {
+                std::cerr << state_file << ": " << e.what() << '\n';
+            }
+        }
+
+        if (hotkeys.rewind) {
+            // Step back one frame per frame, emulation is paused
+            display->process_events(chip8);
+            if (rewind.size() > 1) {
+                rewind.truncate(1);
+                if (rewind.restore(0, state)) {
+                    chip8.load_state(state);
+                    if (clock) { clock.emplace(); }
+                    if (tracer) { tracer->sync(chip8); }
+                    present(chip8.framebuffer());
+                }
+            }
+            std::this_thread::sleep_until(next_frame);
+            continue;
+        }
+
+
+        const std::uint64_t first_cycle{ chip8.get_cycle_count() };
+
+        if (clock) {
+            // Timers tick inside the frame, at their emulated cycle
+            bool vblank{ false };
+            while (!vblank) {
+                display->process_events(chip8);
+                if (debugger_quit()) {
+                    quit = true;
+                    break;
+                }
+                const Short pc{ chip8.get_pc() };
+                vblank = clock->step(chip8);
+                if (tracer) { tracer->record(pc, chip8); }
+                count_sprite();
+                if (opts->trace) { debug::pretty_print_state(chip8); }
+            }
+        } else {
+            for (unsigned cycle{ 0 };
+                cycle < cycles_per_frame;
+                ++cycle)
+            {
+                display->process_events(chip8);
+                if (debugger_quit()) {
+                    quit = true;
+                    break;
+                }
+                const Short pc{ chip8.get_pc() };
+                chip8.emulate_cycle();
+                if (tracer) { tracer->record(pc, chip8); }
+                count_sprite();
+                if (opts->trace) { debug::pretty_print_state(chip8); }
+                // debug::print_keypad(chip8.get_keys());
+            }
+
+            chip8.update_timers();
+        }
+
+        if (quit) { break; }
+
+        if (chip8.get_fault() != Chip8::Fault::none) {
+            fmt::print(
+                stderr, "Halted on {}: {:#06x} at {:#05x}\n",
+                to_string(chip8.get_fault()), chip8.get_opcode(), chip8.get_pc()
+            );
+            halted = true;
+            break;
+        }
+
+        stats.frames.add();
+        stats.instructions.add(chip8.get_cycle_count() - first_cycle);
+        rate_instructions += chip8.get_cycle_count() - first_cycle;
 
+        chip8.save_state(state);
+        rewind.push(state);
 
-        for (unsigned cycle{ 0 };
-            cycle < cycles_per_frame;
-            ++cycle)
-        {
-            canvas.process_events(chip8);
-            chip8.emulate_cycle();
-            debug::pretty_print_state(chip8);
-            // debug::print_keypad(chip8.get_keys());
+        ++frame_count;
+        if (recorder && frame_count % hash_interval == 0) {
+            recorder->state_hash(chip8.get_cycle_count(), snapshot::hash(state));
         }
 
-        chip8.update_timers();
+        if (run_ahead) {
+            // Present the frame run_ahead frames into the future,
+            // as if the current input was held, then roll back to state.
+            const bool drew{ chip8.should_draw() };
+            chip8.set_buzzer_queue(nullptr);
+
+            // Rolled back along with the state
+            auto ahead_clock = clock;
+
+            for (unsigned ahead{ 0 }; ahead < run_ahead; ++ahead) {
+                if (ahead_clock) {
+                    ahead_clock->run_frame(chip8);
+                    continue;
+                }
+                for (unsigned cycle{ 0 }; cycle < cycles_per_frame; ++cycle) {
+                    chip8.emulate_cycle();
+                }
+                chip8.update_timers();
+            }
 
-        if (chip8.should_draw()) {
-            canvas.update(chip8.framebuffer());
-            canvas.redraw();
+            if (drew || chip8.should_draw()) {
+                present(chip8.framebuffer());
+            }
+
+            chip8.load_state(state);
+            chip8.reset_draw_flag();
+            chip8.set_buzzer_queue(&audio->queue());
+
+        } else if (chip8.should_draw()) {
+            present(chip8.framebuffer());
             chip8.reset_draw_flag();
         }
 
-        std::this_thread::sleep_until(next_frame);
+        const auto frame_end = std::chrono::steady_clock::now();
+        stats.frame_time.observe(frame_end - frame_start);
+        if (!opts->uncapped && frame_end > next_frame) {
+            stats.frames_dropped.add();
+        }
+        if (frame_end - rate_start >= std::chrono::seconds{ 1 }) {
+            stats.instructions_per_second.set(
+                rate_instructions / std::chrono::duration<double>(frame_end - rate_start).count()
+            );
+            rate_start = frame_end;
+            rate_instructions = 0;
+        }
+
+        if (opts->frames && frame_count >= opts->frames) {
+            break;
+        }
+
+        if (!opts->uncapped) {
+            std::this_thread::sleep_until(next_frame);
+        }
+
+    }
+
+    exporter.reset();
+    display->set_metrics(nullptr);
+
+    chip8.set_buzzer_queue(nullptr);
+
+    if (capture) {
+        capture->finish();
+        if (capture->dropped()) {
+            fmt::print(stderr, "Capture dropped {} frames\n", capture->dropped());
+        }
+    }
+
+    if (tracer && !tracer->finish()) {
+        fmt::print(stderr, "Unable to write trace {}, it is cut short\n", opts->trace_file);
+    }
+
+    if (recorder) {
+        display->set_recorder(nullptr);
+        recorder->finish(chip8.get_cycle_count());
+    }
 
+    auto latency = audio->latency().summary();
+    if (latency.count) {
+        fmt::print(
+            stderr, "Audio latency: mean {}us, max {}us over {} events\n",
+            latency.mean.count() / 1000, latency.max.count() / 1000, latency.count
+        );
     }
 
+    return halted ? 1 : 0;
 }
@@ -0,0 +1,308 @@
+// Decodes frame streams written with --capture
+// and exports ranges of them as PPM images or an animated GIF.
+#include "FrameStream.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+struct Options {
+    std::string file;
+    std::uint64_t from{ 0 };
+    std::optional<std::uint64_t> to{};
+    unsigned scale{ 4 };
+    std::string ppm;
+    std::string gif;
+};
+
+static constexpr std::string_view usage{
+    "Usage:\n"
+    "    chip8-frames [options] <stream>\n"
+    "Options:\n"
+    "    --from=<n>        First frame to export (default 0)\n"
+    "    --to=<n>          Stop before frame n (default: all)\n"
+    "    --scale=<n>       Size of a pixel (default 4)\n"
+    "    --ppm=<prefix>    Write each frame to <prefix>-<frame>.ppm\n"
+    "    --gif=<path>      Write an animated GIF, timed by emulated frames\n"
+    "Without an output, prints what's in the stream.\n"
+};
+
+// Same as the window, Solarized Dark
+constexpr std::array<Byte, 3> background{ 0x00, 0x2B, 0x36 };
+constexpr std::array<Byte, 3> foreground{ 0x83, 0x94, 0x96 };
+
+
+static std::optional<Options> parse_args(int argc, const char* argv[]) {
+    Options opts{};
+
+    for (int i{ 1 }; i < argc; ++i) {
+        std::string_view arg{ argv[i] };
+        try {
+            if (arg.starts_with("--from=")) {
+                opts.from = std::stoull(std::string{ arg.substr(7) });
+            } else if (arg.starts_with("--to=")) {
+                opts.to = std::stoull(std::string{ arg.substr(5) });
+            } else if (arg.starts_with("--scale=")) {
+                opts.scale = static_cast<unsigned>(std::stoul(std::string{ arg.substr(8) }));
+            } else if (arg.starts_with("--ppm=")) {
+                opts.ppm = arg.substr(6);
+            } else if (arg.starts_with("--gif=")) {
+                opts.gif = arg.substr(6);
+            } else if (arg.starts_with("--")) {
+                std::cerr << "Unknown option: " << arg << '\n';
+                return {};
+            } else {
+                opts.file = arg;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value: " << arg << '\n';
+            return {};
+        }
+    }
+
+    if (opts.file.empty() || opts.scale == 0 || opts.scale > 64) { return {}; }
+    return opts;
+}
+
+
+
+
+static void write_ppm(const std::string& path, const Chip8::framebuffer_t& fb, unsigned scale) {
+    std::ofstream fs{ path, std::ios_base::binary };
+    fs << fmt::format("P6\n{} {}\n255\n", Chip8Base::fb_width * scale, Chip8Base::fb_height * scale);
+
+    std::vector<char> row;
+    row.reserve(Chip8Base::fb_width * scale * 3);
+    for (size_t y{ 0 }; y < Chip8Base::fb_height; ++y) {
+        row.clear();
+        for (size_t x{ 0 }; x < Chip8Base::fb_width; ++x) {
+            const auto& color = Chip8::pixel(fb, x, y) ? foreground : background;
+            for (unsigned i{ 0 }; i < scale; ++i) {
+                row.insert(row.end(), color.begin(), color.end());
+            }
+        }
+        for (unsigned i{ 0 }; i < scale; ++i) {
+            fs.write(row.data(), static_cast<std::streamsize>(row.size()));
+        }
+    }
+    if (fs.fail()) {
+        throw std::runtime_error{ "Unable to write " + path };
+    }
+}
+
+
+
+
+// Animated GIF with a two color palette
+class GifWriter {
+private:
+    static constexpr unsigned min_code_size{ 2 };
+    static constexpr unsigned clear_code{ 1u << min_code_size };
+    static constexpr unsigned end_code{ clear_code + 1 };
+
+    std::ofstream fs_;
+    unsigned width_;
+    unsigned height_;
+    unsigned scale_;
+
+    // LZW state
+    std::vector<Byte> out_;
+    std::uint32_t bits_{ 0 };
+    unsigned bit_count_{ 0 };
+
+public:
+    GifWriter(const std::string& path, unsigned scale) :
+        fs_{ path, std::ios_base::binary },
+        width_{ static_cast<unsigned>(Chip8Base::fb_width) * scale },
+        height_{ static_cast<unsigned>(Chip8Base::fb_height) * scale },
+        scale_{ scale }
+    {
+        if (fs_.fail()) {
+            throw std::runtime_error{ "Unable to create " + path };
+        }
+
+        std::vector<Byte> header{ 'G', 'I', 'F', '8', '9', 'a' };
+        put_u16(header, width_);
+        put_u16(header, height_);
+        // Global color table of 2 entries
+        header.insert(header.end(), { 0x80, 0x00, 0x00 });
+        header.insert(header.end(), background.begin(), background.end());
+        header.insert(header.end(), foreground.begin(), foreground.end());
+        // Loop forever
+        header.insert(header.end(), { 0x21, 0xFF, 0x0B });
+        for (char c : std::string_view{ "NETSCAPE2.0" }) { header.push_back(static_cast<Byte>(c)); }
+        header.insert(header.end(), { 0x03, 0x01, 0x00, 0x00, 0x00 });
+        write(header);
+    }
+
+    ~GifWriter() {
+        fs_.put(0x3B);
+    }
+
+    void add(const Chip8::framebuffer_t& fb, unsigned delay_cs) {
+        std::vector<Byte> block{ 0x21, 0xF9, 0x04, 0x00 };
+        put_u16(block, delay_cs);
+        block.insert(block.end(), { 0x00, 0x00 });
+
+        block.push_back(0x2C);
+        put_u16(block, 0);
+        put_u16(block, 0);
+        put_u16(block, width_);
+        put_u16(block, height_);
+        block.push_back(0x00);
+        block.push_back(min_code_size);
+        write(block);
+
+        encode(fb);
+    }
+
+    bool ok() const { return !fs_.fail(); }
+
+private:
+    static void put_u16(std::vector<Byte>& out, unsigned v) {
+        out.push_back(static_cast<Byte>(v));
+        out.push_back(static_cast<Byte>(v >> 8));
+    }
+
+    void write(const std::vector<Byte>& bytes) {
+        fs_.write(reinterpret_cast<const char*>(bytes.data()),
+            static_cast<std::streamsize>(bytes.size()));
+    }
+
+    void put_code(unsigned code, unsigned size) {
+        bits_ |= std::uint32_t{ code } << bit_count_;
+        bit_count_ += size;
+        while (bit_count_ >= 8) {
+            out_.push_back(static_cast<Byte>(bits_));
+            bits_ >>= 8;
+            bit_count_ -= 8;
+        }
+    }
+
+    void encode(const Chip8::framebuffer_t& fb) {
+        // Children of each code for pixel values 0 and 1, 0 if none
+        std::vector<std::array<std::uint16_t, 2>> tree(4096);
+        unsigned size{ min_code_size + 1 };
+        unsigned max_code{ end_code };
+
+        out_.clear();
+        bits_ = 0;
+        bit_count_ = 0;
+        put_code(clear_code, size);
+
+        std::optional<unsigned> current{};
+        for (unsigned y{ 0 }; y < height_; ++y) {
+            for (unsigned x{ 0 }; x < width_; ++x) {
+                const unsigned value{ Chip8::pixel(fb, x / scale_, y / scale_) };
+                if (!current) {
+                    current = value;
+                    continue;
+                }
+                if (tree[*current][value]) {
+                    current = tree[*current][value];
+                    continue;
+                }
+
+                put_code(*current, size);
+                tree[*current][value] = static_cast<std::uint16_t>(++max_code);
+                if (max_code >= (1u << size)) { ++size; }
+                if (max_code == 4095) {
+                    put_code(clear_code, size);
+                    std::fill(tree.begin(), tree.end(), std::array<std::uint16_t, 2>{});
+                    size = min_code_size + 1;
+                    max_code = end_code;
+                }
+                current = value;
+            }
+        }
+        put_code(*current, size);
+        put_code(end_code, size);
+        if (bit_count_) { out_.push_back(static_cast<Byte>(bits_)); }
+
+        // Data sub-blocks of at most 255 bytes
+        std::vector<Byte> blocks;
+        for (size_t pos{ 0 }; pos < out_.size(); pos += 255) {
+            const size_t n{ std::min<size_t>(255, out_.size() - pos) };
+            blocks.push_back(static_cast<Byte>(n));
+            blocks.insert(blocks.end(), out_.begin() + pos, out_.begin() + pos + n);
+        }
+        blocks.push_back(0x00);
+        write(blocks);
+    }
+};
+
+
+// GIF delays are in 1/100 s, round frame times so they don't drift
+static unsigned delay_cs(std::uint64_t number, std::uint64_t next_number) {
+    const std::uint64_t from{ number * 100 / 60 };
+    const std::uint64_t to{ next_number > number ? next_number * 100 / 60 : from };
+    // Most viewers slow down anything under 2
+    return static_cast<unsigned>(std::clamp<std::uint64_t>(to - from, 2, 0xFFFF));
+}
+
+
+
+
+int main(int argc, const char* argv[]) {
+
+    auto opts = parse_args(argc, argv);
+    if (!opts) {
+        std::cout << usage;
+        return 0;
+    }
+
+    try {
+        framestream::Reader reader{ opts->file };
+        const std::uint64_t to{ std::min(opts->to.value_or(reader.size()), reader.size()) };
+
+        if (opts->ppm.empty() && opts->gif.empty()) {
+            std::optional<std::uint64_t> first{};
+            std::uint64_t last{ 0 };
+            while (auto frame = reader.next()) {
+                if (!first) { first = frame->number; }
+                last = frame->number;
+            }
+            fmt::print(
+                "{} frames, emulated frames {} to {}, keyframe every {}\n",
+                reader.size(), first.value_or(0), last, reader.keyframe_interval()
+            );
+            return 0;
+        }
+
+        std::optional<GifWriter> gif{};
+        if (!opts->gif.empty()) {
+            gif.emplace(opts->gif, opts->scale);
+        }
+
+        reader.seek(opts->from);
+        auto frame = reader.next();
+        for (std::uint64_t ordinal{ opts->from }; frame && ordinal < to; ++ordinal) {
+            auto next = reader.next();
+
+            if (!opts->ppm.empty()) {
+                write_ppm(fmt::format("{}-{:06}.ppm", opts->ppm, ordinal), frame->rows, opts->scale);
+            }
+            if (gif) {
+                const std::uint64_t next_number{
+                    next && ordinal + 1 < to ? next->number : frame->number + 1
+                };
+                gif->add(frame->rows, delay_cs(frame->number, next_number));
+            }
+            frame = next;
+        }
+
+        if (gif && !gif->ok()) {
+            throw std::runtime_error{ "Unable to write " + opts->gif };
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}
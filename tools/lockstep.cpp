@@ -0,0 +1,180 @@
+// Runs every ROM of a corpus on a reference and a candidate core
+// in lockstep and reports the first instruction where they disagree.
+#include "Chip8.hpp"
+#include "Lockstep.hpp"
+#include "ThreadPool.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// The core under test. Any type satisfying lockstep::Core
+// can go here, Chip8 against itself checks determinism
+// and snapshot restore.
+using Candidate = Chip8;
+
+
+struct Options {
+    std::vector<std::string> paths;
+    lockstep::Config config{};
+    std::uint64_t seed{ Rng::default_seed };
+    size_t threads{ std::thread::hardware_concurrency() };
+};
+
+static constexpr std::string_view usage{
+    "Usage:\n"
+    "    chip8-lockstep [options] <rom or directory>...\n"
+    "Options:\n"
+    "    --frames=<n>      Frames to run per ROM (default 3600)\n"
+    "    --interval=<n>    Frames between state hash checks (default 60)\n"
+    "    --cycles=<n>      Instructions per frame (default 10)\n"
+    "    --seed=<n>        Seed the random number generator and input\n"
+    "    --threads=<n>     Worker threads (default: one per core)\n"
+    "Exits with 1 if any ROM diverged.\n"
+};
+
+
+static std::optional<Options> parse_args(int argc, const char* argv[]) {
+    Options opts{};
+
+    for (int i{ 1 }; i < argc; ++i) {
+        std::string_view arg{ argv[i] };
+        try {
+            if (arg.starts_with("--frames=")) {
+                opts.config.frames = std::stoull(std::string{ arg.substr(9) });
+            } else if (arg.starts_with("--interval=")) {
+                opts.config.check_interval = std::stoull(std::string{ arg.substr(11) });
+            } else if (arg.starts_with("--cycles=")) {
+                opts.config.cycles_per_frame = std::stoul(std::string{ arg.substr(9) });
+            } else if (arg.starts_with("--seed=")) {
+                opts.seed = std::stoull(std::string{ arg.substr(7) }, nullptr, 0);
+            } else if (arg.starts_with("--threads=")) {
+                opts.threads = std::stoul(std::string{ arg.substr(10) });
+            } else if (arg.starts_with("--")) {
+                std::cerr << "Unknown option: " << arg << '\n';
+                return {};
+            } else {
+                opts.paths.emplace_back(arg);
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value: " << arg << '\n';
+            return {};
+        }
+    }
+
+    if (opts.paths.empty() || opts.config.cycles_per_frame == 0) { return {}; }
+    opts.config.input_seed = opts.seed;
+    return opts;
+}
+
+
+
+struct Rom {
+    std::string path;
+    std::vector<Byte> bytes;
+};
+
+// Files as given, directories by their regular files in name order
+static std::vector<Rom> load_corpus(const std::vector<std::string>& paths) {
+    namespace fs = std::filesystem;
+
+    std::vector<std::string> files;
+    for (const auto& path : paths) {
+        if (fs::is_directory(path)) {
+            std::vector<std::string> entries;
+            for (const auto& entry : fs::directory_iterator{ path }) {
+                if (entry.is_regular_file()) { entries.push_back(entry.path().string()); }
+            }
+            std::sort(entries.begin(), entries.end());
+            files.insert(files.end(), entries.begin(), entries.end());
+        } else {
+            files.push_back(path);
+        }
+    }
+
+    std::vector<Rom> roms;
+    for (auto& file : files) {
+        std::ifstream fs{ file, std::ios_base::binary };
+        if (fs.fail()) {
+            throw std::runtime_error{ "Unable to open " + file };
+        }
+        roms.push_back(Rom{
+            std::move(file),
+            { std::istreambuf_iterator<char>(fs), std::istreambuf_iterator<char>() }
+        });
+    }
+    return roms;
+}
+
+
+
+
+int main(int argc, const char* argv[]) {
+
+    auto opts = parse_args(argc, argv);
+    if (!opts) {
+        std::cout << usage;
+        return 0;
+    }
+
+    std::vector<Rom> roms;
+    try {
+        roms = load_corpus(opts->paths);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    std::vector<lockstep::Result> results(roms.size());
+
+    const auto start = std::chrono::steady_clock::now();
+    ThreadPool pool{ opts->threads };
+    pool.parallel_for(roms.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i{ begin }; i < end; ++i) {
+            Chip8 reference{};
+            reference.load_program(roms[i].bytes);
+            reference.seed(opts->seed);
+
+            Candidate candidate{};
+            results[i] = lockstep::compare(reference, candidate, reference.snapshot(), opts->config);
+        }
+    });
+    const std::chrono::duration<double> elapsed{ std::chrono::steady_clock::now() - start };
+
+    std::uint64_t instructions{ 0 };
+    size_t diverged{ 0 };
+    for (size_t i{ 0 }; i < roms.size(); ++i) {
+        const auto& result = results[i];
+        instructions += result.instructions;
+
+        if (result.unreproducible) {
+            ++diverged;
+            fmt::print("UNSTABLE                   {}\n", roms[i].path);
+            fmt::print("States differed by instruction {} but not when replayed from the "
+                "checkpoint before it\n\n", result.instructions);
+            continue;
+        }
+        if (!result.divergence) {
+            fmt::print("ok       {:016x}  {}\n", result.reference_hash, roms[i].path);
+            continue;
+        }
+        ++diverged;
+        fmt::print("DIVERGED                   {}\n", roms[i].path);
+        fmt::print("{}\n", lockstep::describe(*result.divergence, opts->config));
+    }
+
+    fmt::print(
+        "{} ROMs, {} diverged, {} instructions per core in {:.2f}s ({:.1f}M/s)\n",
+        roms.size(), diverged, instructions, elapsed.count(),
+        instructions / elapsed.count() / 1e6
+    );
+    return diverged ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+// Answers questions about traces written with --trace-file,
+// decoding only the blocks whose index entries can't rule them out.
+#include "Debug.hpp"
+#include "Trace.hpp"
+#include <fmt/format.h>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+struct Pattern {
+    Short mask{};
+    Short value{};
+
+    bool matches(Short opcode) const noexcept { return (opcode & mask) == value; }
+};
+
+// A register after an instruction
+struct Set {
+    // 0x0..0xF for Vx, 16 for I
+    unsigned reg{};
+    // Any change if not set
+    std::optional<Short> value{};
+};
+
+struct Options {
+    std::string file;
+    std::optional<Short> writes{};
+    std::optional<Short> at{};
+    std::optional<std::uint64_t> before{};
+    std::uint64_t count{ 100 };
+    std::optional<Pattern> first{};
+    std::optional<Set> set{};
+};
+
+static constexpr std::string_view usage{
+    "Usage:\n"
+    "    chip8-trace [query] <trace>\n"
+    "Queries:\n"
+    "    --writes=<addr>   Every instruction that wrote memory at addr\n"
+    "    --at=<addr>       Every time the instruction at addr ran\n"
+    "    --before=<cycle>  The last instructions before cycle\n"
+    "    --count=<n>       How many, with --before (default 100)\n"
+    "    --first=<opcode>  The first instruction matching an opcode pattern,\n"
+    "                      X, Y and N match any digit, as in DXYN\n"
+    "    --set=<reg>       With --first, only if it changed V<x> or I,\n"
+    "                      or with <reg>=<value> left it at value,\n"
+    "                      e.g. --first=DXYN --set=VF=1 for the first collision\n"
+    "Addresses are hex. Without a query, prints what's in the trace.\n"
+};
+
+
+static Short parse_address(std::string_view text) {
+    size_t used{ 0 };
+    const auto value = std::stoul(std::string{ text }, &used, 16);
+    if (used != text.size() || value >= Chip8Base::memory_size) {
+        throw std::invalid_argument{ "Invalid address" };
+    }
+    return static_cast<Short>(value);
+}
+
+static Pattern parse_pattern(std::string_view text) {
+    if (text.size() != 4) { throw std::invalid_argument{ "Invalid pattern" }; }
+
+    Pattern pattern{};
+    for (char c : text) {
+        pattern.mask <<= 4;
+        pattern.value <<= 4;
+        if (c == 'X' || c == 'Y' || c == 'N' || c == 'x' || c == 'y' || c == 'n') { continue; }
+
+        const auto digit = std::stoul(std::string{ c }, nullptr, 16);
+        pattern.mask |= 0xF;
+        pattern.value |= static_cast<Short>(digit);
+    }
+    return pattern;
+}
+
+static Set parse_set(std::string_view text) {
+    Set set{};
+    const auto eq = text.find('=');
+    const std::string_view reg{ text.substr(0, eq) };
+
+    if (reg == "I") {
+        set.reg = 16;
+    } else if (reg.size() == 2 && (reg[0] == 'V' || reg[0] == 'v')) {
+        set.reg = static_cast<unsigned>(std::stoul(std::string{ reg.substr(1) }, nullptr, 16));
+    } else {
+        throw std::invalid_argument{ "Invalid register" };
+    }
+    if (eq != std::string_view::npos) {
+        set.value = static_cast<Short>(std::stoul(std::string{ text.substr(eq + 1) }, nullptr, 0));
+    }
+    return set;
+}
+
+
+static std::optional<Options> parse_args(int argc, const char* argv[]) {
+    Options opts{};
+
+    for (int i{ 1 }; i < argc; ++i) {
+        std::string_view arg{ argv[i] };
+        try {
+            if (arg.starts_with("--writes=")) {
+                opts.writes = parse_address(arg.substr(9));
+            } else if (arg.starts_with("--at=")) {
+                opts.at = parse_address(arg.substr(5));
+            } else if (arg.starts_with("--before=")) {
+                opts.before = std::stoull(std::string{ arg.substr(9) });
+            } else if (arg.starts_with("--count=")) {
+                opts.count = std::stoull(std::string{ arg.substr(8) });
+            } else if (arg.starts_with("--first=")) {
+                opts.first = parse_pattern(arg.substr(8));
+            } else if (arg.starts_with("--set=")) {
+                opts.set = parse_set(arg.substr(6));
+            } else if (arg.starts_with("--")) {
+                std::cerr << "Unknown option: " << arg << '\n';
+                return {};
+            } else {
+                opts.file = arg;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Invalid value: " << arg << '\n';
+            return {};
+        }
+    }
+
+    const int queries{ opts.writes.has_value() + opts.at.has_value() +
+        opts.before.has_value() + opts.first.has_value() };
+    if (opts.file.empty() || queries > 1 || (opts.set && !opts.first)) { return {}; }
+    return opts;
+}
+
+
+
+
+static void print_step(const trace::Step& step) {
+    const debug::OpcodeInfo info{ debug::disassemble(step.opcode) };
+    fmt::print("{:>12}  {:03X}: {:04X}  {:8} {:5}  I={:03X} V[{:02X}]",
+        step.cycle, step.pc, step.opcode, info.name, info.pattern,
+        step.I, fmt::join(step.V, ","));
+    if (step.write_size) {
+        fmt::print("  wrote {:03X}+{}", step.write_address, step.write_size);
+    }
+    fmt::print("\n");
+}
+
+
+static void print_summary(const trace::Reader& reader) {
+    const auto& blocks = reader.blocks();
+    std::uint64_t instructions{ 0 };
+    std::uint64_t first{ UINT64_MAX };
+    std::uint64_t last{ 0 };
+    for (const auto& block : blocks) {
+        instructions += block.count;
+        first = std::min(first, block.first_cycle);
+        last = std::max(last, block.first_cycle + block.count);
+    }
+
+    fmt::print("{} instructions in {} blocks of up to {}, {} bytes ({:.2f} per instruction)\n",
+        instructions, blocks.size(), reader.block_size(), reader.file_size(),
+        instructions ? static_cast<double>(reader.file_size()) / instructions : 0.0);
+    if (!blocks.empty()) {
+        fmt::print("Cycles {} to {}\n", first, last);
+    }
+    if (!reader.indexed()) {
+        fmt::print("No index, the trace was cut short and the index rebuilt\n");
+    }
+}
+
+
+// Calls f on each instruction of the blocks keep() lets through,
+// in order, until it returns false
+template<typename Keep, typename F>
+static void for_each_step(const trace::Reader& reader, Keep keep, F f) {
+    std::vector<trace::Step> steps;
+    for (size_t i{ 0 }; i < reader.blocks().size(); ++i) {
+        if (!keep(reader.blocks()[i])) { continue; }
+        reader.decode(i, steps);
+        for (const auto& step : steps) {
+            if (!f(step)) { return; }
+        }
+    }
+}
+
+
+// Blocks run after a state load can repeat cycles,
+// the latest ones in the file win
+static size_t print_before(const trace::Reader& reader, std::uint64_t cycle, std::uint64_t count) {
+    std::deque<trace::Step> last;
+    std::vector<trace::Step> steps;
+
+    const auto& blocks = reader.blocks();
+    for (size_t i{ blocks.size() }; i-- > 0 && last.size() < count; ) {
+        if (blocks[i].first_cycle >= cycle) { continue; }
+        reader.decode(i, steps);
+        for (auto it = steps.rbegin(); it != steps.rend() && last.size() < count; ++it) {
+            if (it->cycle < cycle && (last.empty() || it->cycle < last.front().cycle)) {
+                last.push_front(*it);
+            }
+        }
+    }
+    for (const auto& step : last) { print_step(step); }
+    return last.size();
+}
+
+
+
+
+int main(int argc, const char* argv[]) {
+
+    auto opts = parse_args(argc, argv);
+    if (!opts) {
+        std::cout << usage;
+        return 0;
+    }
+
+    try {
+        const trace::Reader reader{ opts->file };
+        size_t found{ 0 };
+
+        if (opts->writes) {
+            const std::uint64_t page{ trace::pages(*opts->writes, 1) };
+            for_each_step(reader,
+                [&](const trace::BlockInfo& b) { return b.written_pages & page; },
+                [&](const trace::Step& step) {
+                    if (step.wrote(*opts->writes)) {
+                        print_step(step);
+                        ++found;
+                    }
+                    return true;
+                });
+
+        } else if (opts->at) {
+            const std::uint64_t page{ trace::pages(*opts->at, 1) };
+            for_each_step(reader,
+                [&](const trace::BlockInfo& b) { return b.pc_pages & page; },
+                [&](const trace::Step& step) {
+                    if (step.pc % Chip8Base::memory_size == *opts->at) {
+                        print_step(step);
+                        ++found;
+                    }
+                    return true;
+                });
+
+        } else if (opts->before) {
+            found = print_before(reader, *opts->before, opts->count);
+
+        } else if (opts->first) {
+            const Pattern pattern{ *opts->first };
+            const std::optional<Set> set{ opts->set };
+            const std::uint32_t bit{ set ? 1u << set->reg : 0u };
+
+            for_each_step(reader,
+                [&](const trace::BlockInfo& b) {
+                    const bool group{ (pattern.mask & 0xF000) != 0xF000 ||
+                        ((b.opcode_groups >> (pattern.value >> 12)) & 1) };
+                    // An instruction can leave a register at the value it had
+                    return group && (!set || set->value || (b.changed & bit));
+                },
+                [&](const trace::Step& step) {
+                    if (!pattern.matches(step.opcode)) { return true; }
+                    if (set) {
+                        const Short now{ set->reg == 16 ? step.I : Short{ step.V[set->reg] } };
+                        if (set->value ? now != *set->value : !(step.changed & bit)) { return true; }
+                    }
+                    print_step(step);
+                    ++found;
+                    return false;
+                });
+
+        } else {
+            print_summary(reader);
+            return 0;
+        }
+
+        fmt::print("{} found, decoded {} of {} blocks\n",
+            found,
+            reader.decoded(), reader.blocks().size());
+
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}